@@ -0,0 +1,301 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mpi.h"
+#include "balance.h"
+#include "communication.h"
+#include "fluid.h"
+
+void init_balance(balance_t *balance, comm_graph_t *graph)
+{
+    int i;
+
+    balance->steps = 0;
+    balance->compute_time = 0.0;
+    balance->histogram = malloc(graph->num_strips * sizeof(int));
+    balance->gathered = malloc(BALANCE_GATHERED * graph->nprocs * sizeof(int));
+    balance->speeds = calloc(graph->nprocs, sizeof(float));
+    balance->active = malloc(graph->nprocs * sizeof(char));
+    balance->shares = malloc(graph->nprocs * sizeof(float));
+    balance->times = malloc(graph->nprocs * sizeof(float));
+    balance->num_owned = malloc(graph->nprocs * sizeof(int));
+
+    // Unknown until the first balance, which then places every strip
+    for(i=0; i<graph->nprocs; i++)
+        balance->active[i] = -1;
+}
+
+void free_balance(balance_t *balance)
+{
+    free(balance->histogram);
+    free(balance->gathered);
+    free(balance->speeds);
+    free(balance->active);
+    free(balance->shares);
+    free(balance->times);
+    free(balance->num_owned);
+}
+
+// Lead: give the active ranks contiguous runs of strips in order along x, each a share of the work in proportion to its speed
+// Partitions are made of whole strips, so each is cut at the strip boundary nearest its work quantile rather than at the
+// quantile itself and the split is only as even as the work in one strip, a STRIPS_PER_RANK'th of an average partition
+// Every active rank gets at least one strip
+static void split_strips(balance_t *balance, comm_graph_t *graph, long total_work, float total_speed)
+{
+    int i, s, end, rank;
+    int num_strips = graph->num_strips;
+    int *work = balance->histogram;
+
+    int num_active = 0;
+    for(rank=0; rank<graph->nprocs; rank++) {
+        if(balance->shares[rank] > 0.0f)
+            num_active++;
+    }
+
+    long count = 0;
+    float target = 0.0f;
+    for(rank=0, i=0, s=0; rank<graph->nprocs; rank++) {
+        if(balance->shares[rank] <= 0.0f)
+            continue;
+        i++;
+        target += total_work*balance->shares[rank]/total_speed;
+        end = i == num_active ? num_strips : num_strips - (num_active - i);
+        do {
+            graph->strip_owners[s] = rank;
+            count += work[s++];
+        } while(s < end && (i == num_active || count + 0.5f*work[s] < target));
+    }
+}
+
+// Lead: move single strips from the slowest rank to the fastest while that lowers the slower of the two
+// A strip next to one the receiving rank already owns is preferred, then one at the end of a run of the giving ranks strips,
+// so partitions only scatter when that's what it takes to even out the load. Returns true if any strip moved
+static bool migrate_strips(balance_t *balance, comm_graph_t *graph)
+{
+    int s, rank, move;
+    int num_strips = graph->num_strips;
+    int *owners = graph->strip_owners;
+    int *work = balance->histogram;
+    float *shares = balance->shares;
+    float *times = balance->times;
+    bool changed = false;
+
+    int slowest, fastest, best, score, best_score;
+    float after, best_after;
+    for(move=0; move<num_strips; move++) {
+        slowest = fastest = -1;
+        for(rank=0; rank<graph->nprocs; rank++) {
+            if(shares[rank] <= 0.0f)
+                continue;
+            if(slowest < 0 || times[rank] > times[slowest])
+                slowest = rank;
+            if(fastest < 0 || times[rank] < times[fastest])
+                fastest = rank;
+        }
+        if(slowest == fastest || balance->num_owned[slowest] < 2)
+            break;
+
+        best = -1;
+        best_score = 0;
+        best_after = times[slowest];
+        for(s=0; s<num_strips; s++) {
+            if(owners[s] != slowest)
+                continue;
+            after = max(times[slowest] - work[s]/shares[slowest], times[fastest] + work[s]/shares[fastest]);
+            if(after >= times[slowest])
+                continue;
+            if((s > 0 && owners[s-1] == fastest) || (s < num_strips-1 && owners[s+1] == fastest))
+                score = 2;
+            else if(s == 0 || s == num_strips-1 || owners[s-1] != slowest || owners[s+1] != slowest)
+                score = 1;
+            else
+                score = 0;
+            if(best < 0 || score > best_score || (score == best_score && after < best_after)) {
+                best = s;
+                best_score = score;
+                best_after = after;
+            }
+        }
+        if(best < 0)
+            break;
+
+        owners[best] = fastest;
+        times[slowest] -= work[best]/shares[slowest];
+        times[fastest] += work[best]/shares[fastest];
+        balance->num_owned[slowest]--;
+        balance->num_owned[fastest]++;
+        changed = true;
+    }
+
+    return changed;
+}
+
+// Lead: reassign strips in graph->strip_owners, returns false if none need to move
+// Once ranks have been added or removed the active ranks are given contiguous runs of strips again. Otherwise strips
+// only move if the slowest active rank is predicted to take more than a fifteenth longer than an ideal split
+static bool place_strips(balance_t *balance, comm_graph_t *graph)
+{
+    int i, s, rank, member;
+    int *gathered = balance->gathered;
+    float *speeds = balance->speeds;
+    float *shares = balance->shares;
+
+    for(rank=0; rank<graph->nprocs; rank++)
+        shares[rank] = 0.0f;
+
+    // Update speeds of ranks that have reported both work and time, and look for added or removed ranks
+    bool resplit = false;
+    float speed;
+    float known_speed = 0.0f;
+    int num_known = 0;
+    int num_active = 0;
+    for(i=0; i<graph->num_members; i++) {
+        member = graph->members[i];
+        if(gathered[BALANCE_GATHERED*i+1] > 0 && gathered[BALANCE_GATHERED*i+2] > 0) {
+            speed = (float)gathered[BALANCE_GATHERED*i+1]/gathered[BALANCE_GATHERED*i+2];
+            speeds[member] = speeds[member] > 0.0f ? 0.9f*speeds[member] + 0.1f*speed : speed;
+        }
+        if(balance->active[member] != gathered[BALANCE_GATHERED*i])
+            resplit = true;
+        balance->active[member] = gathered[BALANCE_GATHERED*i];
+        if(!gathered[BALANCE_GATHERED*i])
+            continue;
+        num_active++;
+        if(speeds[member] > 0.0f) {
+            known_speed += speeds[member];
+            num_known++;
+        }
+    }
+    if(!num_active || (num_active < 2 && !resplit))
+        return false;
+
+    // Ranks that haven't reported yet, such as those just added, are assumed to be of average speed
+    float total_speed = 0.0f;
+    for(i=0; i<graph->num_members; i++) {
+        member = graph->members[i];
+        if(!gathered[BALANCE_GATHERED*i])
+            continue;
+        if(speeds[member] > 0.0f)
+            shares[member] = speeds[member];
+        else
+            shares[member] = num_known ? known_speed/num_known : 1.0f;
+        #ifdef RENDER_HOST_COMPUTE
+        if(gathered[BALANCE_GATHERED*i+3])
+            shares[member] *= RENDER_HOST_SHARE;
+        #endif
+        total_speed += shares[member];
+    }
+
+    long total_work = 0;
+    for(s=0; s<graph->num_strips; s++)
+        total_work += balance->histogram[s];
+
+    if(resplit) {
+        split_strips(balance, graph, total_work, total_speed);
+        return true;
+    }
+
+    // The slowest rank sets the frame rate
+    for(rank=0; rank<graph->nprocs; rank++) {
+        balance->times[rank] = 0.0f;
+        balance->num_owned[rank] = 0;
+    }
+    for(s=0; s<graph->num_strips; s++) {
+        rank = graph->strip_owners[s];
+        if(shares[rank] > 0.0f)
+            balance->times[rank] += balance->histogram[s]/shares[rank];
+        balance->num_owned[rank]++;
+    }
+    float ideal_time = total_work/total_speed;
+    float max_time = 0.0f;
+    for(rank=0; rank<graph->nprocs; rank++)
+        max_time = max(max_time, balance->times[rank]);
+    if(max_time <= ideal_time*(1.0f + 1.0f/15.0f))
+        return false;
+
+    return migrate_strips(balance, graph);
+}
+
+// Rebalance strips from the work of each members last step and its compute time since the last balance
+// The lead decides every owner so all members agree on them, even on hosts that round floats differently
+// Collective over graph->active_comm, returns true if strips have moved and the graph must be updated
+bool balance_partitions(fluid_particle **fluid_particle_pointers, neighbor *neighbors, AABB_t *boundary_global, comm_graph_t *graph, param *params, balance_t *balance)
+{
+    int i, s, work;
+
+    int active_rank;
+    MPI_Comm_rank(graph->active_comm, &active_rank);
+
+    int local[BALANCE_GATHERED];
+    local[0] = params->tunable_params.active;
+    local[1] = 0;
+    local[2] = balance->steps ? 1.0e6*balance->compute_time/balance->steps : 0;
+    local[3] = graph->render_host;
+    memset(balance->histogram, 0, graph->num_strips * sizeof(int));
+    for(i=0; i<params->number_fluid_particles_local; i++) {
+        work = 1 + neighbors[i].number_fluid_neighbors;
+        balance->histogram[strip_index(graph, fluid_particle_pointers[i]->x)] += work;
+        local[1] += work;
+    }
+    balance->steps = 0;
+    balance->compute_time = 0.0;
+
+    MPI_Gather(local, BALANCE_GATHERED, MPI_INT, balance->gathered, BALANCE_GATHERED, MPI_INT, 0, graph->active_comm);
+    MPI_Reduce(active_rank ? balance->histogram : MPI_IN_PLACE, balance->histogram, graph->num_strips, MPI_INT, MPI_SUM, 0, graph->active_comm);
+
+    int changed = 0;
+    if(!active_rank)
+        changed = place_strips(balance, graph);
+    MPI_Bcast(&changed, 1, MPI_INT, 0, graph->active_comm);
+    if(!changed)
+        return false;
+
+    MPI_Bcast(graph->strip_owners, graph->num_strips, MPI_INT, 0, graph->active_comm);
+
+    // The span of this ranks strips is shown as its partition, a rank owning none is outside of the world
+    int first = -1, last = -1;
+    for(s=0; s<graph->num_strips; s++) {
+        if(graph->strip_owners[s] == graph->rank) {
+            if(first < 0)
+                first = s;
+            last = s;
+        }
+    }
+    if(first < 0) {
+        params->tunable_params.node_start_x = boundary_global->max_x + 1.0f;
+        params->tunable_params.node_end_x = params->tunable_params.node_start_x;
+    }
+    else {
+        params->tunable_params.node_start_x = graph->strip_min_x + first*graph->strip_width;
+        params->tunable_params.node_end_x = last == graph->num_strips-1 ? boundary_global->max_x : graph->strip_min_x + (last+1)*graph->strip_width;
+    }
+
+    debug_print("rank %d balanced start_x: %f, end_x: %f\n", graph->rank,
+                params->tunable_params.node_start_x, params->tunable_params.node_end_x);
+
+    return true;
+}
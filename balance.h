@@ -0,0 +1,59 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef fluid_balance_h
+#define fluid_balance_h
+
+typedef struct BALANCE_T balance_t;
+
+#include "fluid.h"
+#include "communication.h"
+
+// Compute ranks rebalance their partitions every BALANCE_STEPS sub-steps
+#ifndef BALANCE_STEPS
+#define BALANCE_STEPS 2
+#endif
+
+// Each member sends the lead its active flag, work, microseconds per step, and whether it shares a render ranks host
+#define BALANCE_GATHERED 4
+
+// Partitions are balanced by the compute ranks themselves, the lead moves whole strips between ranks and every member follows
+// Each ranks share of the work, each particle and its neighbors, is in proportion to its measured speed so slower hosts are given less
+struct BALANCE_T {
+    int steps;           // Sub-steps since the last balance
+    double compute_time; // Seconds spent computing since the last balance, not counting communication
+    int *histogram;      // Work summed in each strip, reduced onto the lead
+    int *gathered;       // Lead: BALANCE_GATHERED ints from each member
+    float *speeds;       // Lead: averaged work per microsecond of each compute rank, 0 until it reports
+    char *active;        // Lead: active flag of each compute rank as of the last balance
+    float *shares;       // Lead: speed each active compute rank is balanced with, 0 if inactive
+    float *times;        // Lead: predicted time each compute rank takes to compute its strips
+    int *num_owned;      // Lead: number of strips owned by each compute rank
+};
+
+void init_balance(balance_t *balance, comm_graph_t *graph);
+void free_balance(balance_t *balance);
+bool balance_partitions(fluid_particle **fluid_particle_pointers, neighbor *neighbors, AABB_t *boundary_global, comm_graph_t *graph, param *params, balance_t *balance);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "mpi.h"
+#include "checkpoint.h"
+#include "communication.h"
+#include "fluid.h"
+
+// Byte offset of the first particle
+static MPI_Offset particles_offset()
+{
+    int param_bytes;
+    MPI_Type_size(TunableParamtype, &param_bytes);
+    return CHECKPOINT_HEADER*sizeof(int) + param_bytes;
+}
+
+// Write every local particle and the lead's parameters, collective over comm
+// Each rank writes its particles after those of lower ranks, so any number of ranks may write a checkpoint
+// The previous checkpoint is only replaced once the new one is complete
+void write_checkpoint(fluid_particle **fluid_particle_pointers, fluid_particle *scratch, MPI_Comm comm, param *params)
+{
+    int i, rank;
+    MPI_Comm_rank(comm, &rank);
+
+    int num_local = params->number_fluid_particles_local;
+    for(i=0; i<num_local; i++)
+        scratch[i] = *fluid_particle_pointers[i];
+
+    int first = 0, total;
+    MPI_Exscan(&num_local, &first, 1, MPI_INT, MPI_SUM, comm);
+    if(rank == 0)
+        first = 0;
+    MPI_Allreduce(&num_local, &total, 1, MPI_INT, MPI_SUM, comm);
+
+    MPI_File file;
+    if(MPI_File_open(comm, CHECKPOINT_FILE ".tmp", MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        if(rank == 0)
+            printf("Could not open %s for writing\n", CHECKPOINT_FILE ".tmp");
+        return;
+    }
+    MPI_File_set_size(file, 0);
+
+    // The header and parameters come from the lead, every rank takes part in each collective write
+    int header[CHECKPOINT_HEADER] = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, total, 0};
+    MPI_File_write_at_all(file, 0, header, rank == 0 ? CHECKPOINT_HEADER : 0, MPI_INT, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, CHECKPOINT_HEADER*sizeof(int), &params->tunable_params, rank == 0 ? 1 : 0, TunableParamtype, MPI_STATUS_IGNORE);
+
+    int particle_bytes;
+    MPI_Type_size(Particletype, &particle_bytes);
+    MPI_File_write_at_all(file, particles_offset() + (MPI_Offset)first*particle_bytes, scratch, num_local, Particletype, MPI_STATUS_IGNORE);
+
+    MPI_File_close(&file);
+
+    if(rank == 0) {
+        if(rename(CHECKPOINT_FILE ".tmp", CHECKPOINT_FILE))
+            printf("Could not replace %s\n", CHECKPOINT_FILE);
+        debug_print("checkpoint: wrote %d particles\n", total);
+    }
+}
+
+// Read the number of particles and the parameters of a checkpoint if one exists, collective over MPI_COMM_COMPUTE
+// Partitions and the active flag are kept, the checkpoint may have been written by a different number of ranks
+// Returns true if the simulation is restarting from the checkpoint
+bool read_checkpoint_header(param *params)
+{
+    MPI_File file;
+    if(MPI_File_open(MPI_COMM_COMPUTE, CHECKPOINT_FILE, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        return false;
+
+    int header[CHECKPOINT_HEADER];
+    tunable_parameters saved;
+    MPI_File_read_at_all(file, 0, header, CHECKPOINT_HEADER, MPI_INT, MPI_STATUS_IGNORE);
+    MPI_File_read_at_all(file, CHECKPOINT_HEADER*sizeof(int), &saved, 1, TunableParamtype, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+
+    if(header[0] != CHECKPOINT_MAGIC || header[1] != CHECKPOINT_VERSION) {
+        if(rank == 0)
+            printf("Ignoring %s, unknown format\n", CHECKPOINT_FILE);
+        return false;
+    }
+
+    saved.node_start_x = params->tunable_params.node_start_x;
+    saved.node_end_x = params->tunable_params.node_end_x;
+    saved.active = params->tunable_params.active;
+    saved.kill_sim = false;
+    params->tunable_params = saved;
+    params->number_fluid_particles_global = header[2];
+
+    if(rank == 0)
+        printf("Restarting from %s with %d particles\n", CHECKPOINT_FILE, header[2]);
+
+    return true;
+}
+
+// Replace the initial particles with those of the checkpoint, collective over MPI_COMM_COMPUTE
+// Every rank reads an equal share of the file, then particles are sent to the active rank whose partition holds them
+// Partitions are placed so each active rank receives about the same number of particles
+void read_checkpoint(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, int max_fluid_particles_local, AABB_t *boundary_global, param *params)
+{
+    int i, b, r;
+
+    int rank, nprocs;
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+    MPI_Comm_size(MPI_COMM_COMPUTE, &nprocs);
+    int nprocs_active = INITIAL_ACTIVE_PROCS(nprocs);
+
+    int num_global = params->number_fluid_particles_global;
+    int first = (long)num_global*rank/nprocs;
+    int num_read = (long)num_global*(rank+1)/nprocs - first;
+
+    int particle_bytes;
+    MPI_Type_size(Particletype, &particle_bytes);
+
+    fluid_particle *read_particles = malloc(num_read * sizeof(fluid_particle));
+    MPI_File file;
+    MPI_File_open(MPI_COMM_COMPUTE, CHECKPOINT_FILE, MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+    MPI_File_read_at_all(file, particles_offset() + (MPI_Offset)first*particle_bytes, read_particles, num_read, Particletype, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    // Count particles along x
+    float world_width = boundary_global->max_x - boundary_global->min_x;
+    float bin_width = world_width/CHECKPOINT_BINS;
+    int *bins = calloc(CHECKPOINT_BINS, sizeof(int));
+    int *particle_bins = malloc(num_read * sizeof(int));
+    for(i=0; i<num_read; i++) {
+        b = (read_particles[i].x - boundary_global->min_x)/bin_width;
+        b = b < 0 ? 0 : (b >= CHECKPOINT_BINS ? CHECKPOINT_BINS-1 : b);
+        particle_bins[i] = b;
+        bins[b]++;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, bins, CHECKPOINT_BINS, MPI_INT, MPI_SUM, MPI_COMM_COMPUTE);
+
+    // Partitions end on the bin edge where their share of particles is reached
+    // owner_bins[r] is the first bin owned by active rank r
+    int *owner_bins = malloc((nprocs_active+1) * sizeof(int));
+    long count = 0;
+    owner_bins[0] = 0;
+    for(r=1, b=0; r<nprocs_active; r++) {
+        while(b < CHECKPOINT_BINS-1 && count < (long)num_global*r/nprocs_active)
+            count += bins[b++];
+        // Every partition is at least one bin wide
+        if(b <= owner_bins[r-1])
+            b = owner_bins[r-1] + 1;
+        owner_bins[r] = b;
+    }
+    owner_bins[nprocs_active] = CHECKPOINT_BINS;
+
+    if(rank < nprocs_active) {
+        params->tunable_params.node_start_x = boundary_global->min_x + owner_bins[rank]*bin_width;
+        params->tunable_params.node_end_x = boundary_global->min_x + owner_bins[rank+1]*bin_width;
+        if(rank == nprocs_active-1)
+            params->tunable_params.node_end_x = boundary_global->max_x;
+    }
+
+    // Group read particles by owner
+    int *send_counts = calloc(nprocs, sizeof(int));
+    int *send_displs = malloc(nprocs * sizeof(int));
+    int *recv_counts = malloc(nprocs * sizeof(int));
+    int *recv_displs = malloc(nprocs * sizeof(int));
+    for(i=0; i<num_read; i++) {
+        for(r=0; particle_bins[i] >= owner_bins[r+1]; r++);
+        particle_bins[i] = r;
+        send_counts[r]++;
+    }
+    int total = 0;
+    for(r=0; r<nprocs; r++) {
+        send_displs[r] = total;
+        total += send_counts[r];
+    }
+    fluid_particle *send_particles = malloc(num_read * sizeof(fluid_particle));
+    for(r=0; r<nprocs; r++)
+        send_counts[r] = 0;
+    for(i=0; i<num_read; i++) {
+        r = particle_bins[i];
+        send_particles[send_displs[r] + send_counts[r]++] = read_particles[i];
+    }
+
+    MPI_Alltoall(send_counts, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_COMPUTE);
+    total = 0;
+    for(r=0; r<nprocs; r++) {
+        recv_displs[r] = total;
+        total += recv_counts[r];
+    }
+
+    // Partitions hold about num_global/nprocs_active particles, which must fit in the particle array
+    if(total > max_fluid_particles_local) {
+        printf("Rank %d restarts with %d particles but has room for %d, raise the scene capacity\n", rank, total, max_fluid_particles_local);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Alltoallv(send_particles, send_counts, send_displs, Particletype,
+                  fluid_particles, recv_counts, recv_displs, Particletype, MPI_COMM_COMPUTE);
+
+    // Ids index neighbor lists, they are those of the rank that wrote the checkpoint until renumbered here
+    for(i=0; i<total; i++) {
+        fluid_particle_pointers[i] = &fluid_particles[i];
+        fluid_particle_pointers[i]->id = i;
+    }
+    for(i=total; i<max_fluid_particles_local; i++)
+        fluid_particle_pointers[i] = NULL;
+    params->number_fluid_particles_local = total;
+    params->max_fluid_particle_index = total - 1;
+
+    printf("Rank %d restarted with %d particles, start_x: %f, end_x: %f\n", rank, total,
+           params->tunable_params.node_start_x, params->tunable_params.node_end_x);
+
+    free(read_particles);
+    free(send_particles);
+    free(particle_bins);
+    free(bins);
+    free(owner_bins);
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+}
@@ -0,0 +1,52 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef fluid_checkpoint_h
+#define fluid_checkpoint_h
+
+#include "fluid.h"
+#include "mpi.h"
+
+// Checkpoints are written every CHECKPOINT_FRAMES frames delivered to the render node
+#ifndef CHECKPOINT_FRAMES
+#define CHECKPOINT_FRAMES 600
+#endif
+
+// Written to CHECKPOINT_FILE.tmp then renamed, compute ranks must share the working directory
+#define CHECKPOINT_FILE "sph.checkpoint"
+
+// File layout: CHECKPOINT_HEADER ints {magic, version, number of particles, reserved},
+// the lead compute ranks tunable_parameters, then every particle, all in native representation
+#define CHECKPOINT_MAGIC 0x43485053 // "SPHC"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER 4
+
+// Particle x positions are counted in this many bins across the world to re-partition a restart
+#define CHECKPOINT_BINS 1024
+
+void write_checkpoint(fluid_particle **fluid_particle_pointers, fluid_particle *scratch, MPI_Comm comm, param *params);
+bool read_checkpoint_header(param *params);
+void read_checkpoint(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, int max_fluid_particles_local, AABB_t *boundary_global, param *params);
+
+#endif
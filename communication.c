@@ -26,26 +26,63 @@ THE SOFTWARE.
 #include "mpi.h"
 #include "communication.h"
 #include "fluid.h"
+#include "frame_stream.h"
 #include <stddef.h>
+#include <string.h>
+#include <time.h>
 
-// Rank 0 is the render node, the rest are compute nodes
+// Set if this rank shares its host with a render rank
+static bool on_render_host;
+
+// Order ranks so that compute ranks sharing a host are consecutive
+// Strips are assigned in compute rank order so neighboring strips share a host whenever possible
+// Hosts are ordered by their lowest MPI_COMM_WORLD rank, render ranks keep their world rank
+static void create_placed_communicator()
+{
+    int world_rank, host_id;
+    MPI_Comm host_comm;
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+
+    // Ranks in host_comm are ordered by world rank, so the host root has the lowest world rank on the host
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &host_comm);
+    host_id = world_rank;
+    MPI_Bcast(&host_id, 1, MPI_INT, 0, host_comm);
+    MPI_Comm_free(&host_comm);
+
+    // Render ranks keep their world rank, so the host root is a render rank if any is on the host
+    on_render_host = host_id < NUM_RENDER_PROCS;
+
+    // Ranks with equal keys are ordered by world rank, so keying compute ranks by host keeps each host's ranks together
+    int key = world_rank;
+    if(world_rank >= NUM_RENDER_PROCS)
+        key = NUM_RENDER_PROCS + host_id;
+    MPI_Comm_split(MPI_COMM_WORLD, 0, key, &MPI_COMM_SIM);
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_SIM, &rank);
+    debug_print("world rank %d placed at rank %d\n", world_rank, rank);
+}
+
+// Ranks below NUM_RENDER_PROCS are render nodes, the rest are compute nodes
 // This will create appropriate MPI communicators
 void create_communicators()
 {
+    create_placed_communicator();
+
     // Extract group handle
-    MPI_Comm_group(MPI_COMM_WORLD, &group_world);    
+    MPI_Comm_group(MPI_COMM_SIM, &group_world);    
 
-    // Add ranks > 0 to group_compute
-    int exclude_rank = 0;
-    MPI_Group_excl(group_world, 1, &exclude_rank, &group_compute);
+    // Add ranks >= NUM_RENDER_PROCS to group_compute
+    int render_ranks[3] = {0, NUM_RENDER_PROCS-1, 1};
+    MPI_Group_range_excl(group_world, 1, &render_ranks, &group_compute);
 
     // Create render group
-    int include_rank = 0;
-    MPI_Group_incl(group_world, 1, &include_rank, &group_render);
-
-    // Create communicator from group_compute
-    MPI_Comm_create(MPI_COMM_WORLD, group_compute, &MPI_COMM_COMPUTE);
+    MPI_Group_range_incl(group_world, 1, &render_ranks, &group_render);
 
+    // Create communicators from group_compute and group_render
+    MPI_Comm_create(MPI_COMM_SIM, group_compute, &MPI_COMM_COMPUTE);
+    MPI_Comm_create(MPI_COMM_SIM, group_render, &MPI_COMM_RENDER);
 }
 
 void createMpiTypes()
@@ -78,11 +115,12 @@ void createMpiTypes()
     MPI_Type_commit( &Particletype );
 
     // Create param type
-    for(i=0; i<15; i++) types[i] = MPI_FLOAT;
-    types[15] = MPI_CHAR;
-    types[16] = MPI_CHAR;
-    types[17] = MPI_CHAR;
-    for (i=0; i<18; i++) blocklens[i] = 1;
+    for(i=0; i<20; i++) types[i] = MPI_FLOAT;
+    types[20] = MPI_CHAR;
+    types[21] = MPI_CHAR;
+    types[22] = MPI_CHAR;
+    types[23] = MPI_CHAR;
+    for (i=0; i<24; i++) blocklens[i] = 1;
     // Get displacement of each struct member
     disps[0] = offsetof( tunable_parameters, rest_density );
     disps[1] = offsetof( tunable_parameters, smoothing_radius );
@@ -93,18 +131,24 @@ void createMpiTypes()
     disps[6] = offsetof( tunable_parameters, sigma );
     disps[7] = offsetof( tunable_parameters, beta );
     disps[8] = offsetof( tunable_parameters, time_step );
-    disps[9] = offsetof( tunable_parameters, node_start_x );
-    disps[10] = offsetof( tunable_parameters, node_end_x );
-    disps[11] = offsetof( tunable_parameters, mover_center_x );
-    disps[12] = offsetof( tunable_parameters, mover_center_y );
-    disps[13] = offsetof( tunable_parameters, mover_width );
-    disps[14] = offsetof( tunable_parameters, mover_height );
-    disps[15] = offsetof( tunable_parameters, mover_type );
-    disps[16] = offsetof( tunable_parameters, kill_sim );
-    disps[17] = offsetof( tunable_parameters, active );
+    disps[9] = offsetof( tunable_parameters, halo_refresh_fraction );
+    disps[10] = offsetof( tunable_parameters, node_start_x );
+    disps[11] = offsetof( tunable_parameters, node_end_x );
+    disps[12] = offsetof( tunable_parameters, mover_center_x );
+    disps[13] = offsetof( tunable_parameters, mover_center_y );
+    disps[14] = offsetof( tunable_parameters, mover_width );
+    disps[15] = offsetof( tunable_parameters, mover_height );
+    disps[16] = offsetof( tunable_parameters, view_min_x );
+    disps[17] = offsetof( tunable_parameters, view_min_y );
+    disps[18] = offsetof( tunable_parameters, view_max_x );
+    disps[19] = offsetof( tunable_parameters, view_max_y );
+    disps[20] = offsetof( tunable_parameters, mover_type );
+    disps[21] = offsetof( tunable_parameters, kill_sim );
+    disps[22] = offsetof( tunable_parameters, active );
+    disps[23] = offsetof( tunable_parameters, density_field );
 
     // Commit type
-    MPI_Type_create_struct( 18, blocklens, disps, types, &TunableParamtype );
+    MPI_Type_create_struct( 24, blocklens, disps, types, &TunableParamtype );
     MPI_Type_commit( &TunableParamtype );
 }
 
@@ -115,337 +159,1572 @@ void freeMpiTypes()
 
     MPI_Group_free(&group_world);
     MPI_Group_free(&group_compute);
+    MPI_Group_free(&group_render);
+}
+
+#ifdef PROGRESS_THREAD
+// Poll MPI while resumed until stopped, most MPI implementations only progress nonblocking transfers inside MPI calls
+// While paused the thread waits without polling, so it only takes time from the main thread while a transfer is outstanding
+static void *progress_loop(void *arg)
+{
+    progress_t *progress = arg;
+    int flag;
+    struct timespec interval = {0, PROGRESS_INTERVAL_US * 1000};
+
+    while(atomic_load(&progress->running)) {
+        pthread_mutex_lock(&progress->lock);
+        while(!progress->polling && atomic_load(&progress->running))
+            pthread_cond_wait(&progress->wake, &progress->lock);
+        pthread_mutex_unlock(&progress->lock);
+
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, progress->comm, &flag, MPI_STATUS_IGNORE);
+        nanosleep(&interval, NULL);
+    }
+
+    return NULL;
+}
+
+// Start a thread to progress this ranks outstanding requests during computation
+// Collective over MPI_COMM_COMPUTE
+void start_progress_thread(progress_t *progress)
+{
+    int provided;
+    MPI_Query_thread(&provided);
+
+    // The thread polls on its own communicator so it never matches the simulations messages
+    MPI_Comm_dup(MPI_COMM_COMPUTE, &progress->comm);
+    atomic_store(&progress->running, provided == MPI_THREAD_MULTIPLE);
+    pthread_mutex_init(&progress->lock, NULL);
+    pthread_cond_init(&progress->wake, NULL);
+    progress->polling = false;
+
+    if(provided != MPI_THREAD_MULTIPLE) {
+        printf("MPI_THREAD_MULTIPLE not provided, progress thread disabled\n");
+        return;
+    }
+
+    if(pthread_create(&progress->thread, NULL, progress_loop, progress)) {
+        printf("Could not create progress thread\n");
+        atomic_store(&progress->running, false);
+    }
 }
 
-void startHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, param *params)
+void stop_progress_thread(progress_t *progress)
+{
+    if(atomic_load(&progress->running)) {
+        pthread_mutex_lock(&progress->lock);
+        atomic_store(&progress->running, false);
+        pthread_cond_signal(&progress->wake);
+        pthread_mutex_unlock(&progress->lock);
+        pthread_join(progress->thread, NULL);
+    }
+
+    pthread_cond_destroy(&progress->wake);
+    pthread_mutex_destroy(&progress->lock);
+    MPI_Comm_free(&progress->comm);
+}
+
+// Poll MPI from the thread once a transfer has been started and computation follows
+void resume_progress_thread(progress_t *progress)
+{
+    pthread_mutex_lock(&progress->lock);
+    progress->polling = true;
+    pthread_cond_signal(&progress->wake);
+    pthread_mutex_unlock(&progress->lock);
+}
+
+// Stop polling before waiting on the transfer, the wait progresses it
+void pause_progress_thread(progress_t *progress)
+{
+    pthread_mutex_lock(&progress->lock);
+    progress->polling = false;
+    pthread_mutex_unlock(&progress->lock);
+}
+#endif
+
+// Create active_comm, and the communicators derived from it, from the member list
+// Collective over the members
+static void create_active_comm(comm_graph_t *graph)
+{
+    int i;
+    MPI_Group group;
+
+    MPI_Group_incl(group_compute, graph->num_members, graph->members, &group);
+    MPI_Comm_create_group(MPI_COMM_COMPUTE, group, ACTIVE_COMM_TAG, &graph->active_comm);
+    MPI_Group_free(&group);
+
+    for(i=0; i<graph->nprocs; i++)
+        graph->active_ranks[i] = -1;
+    for(i=0; i<graph->num_members; i++)
+        graph->active_ranks[graph->members[i]] = i;
+
+    #ifdef SHM_HALO
+    MPI_Comm_split_type(graph->active_comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &graph->active_node_comm);
+    #endif
+}
+
+// Free active_comm and the communicators derived from it, collective over the members
+static void free_active_comm(comm_graph_t *graph)
+{
+    if(graph->comm != MPI_COMM_NULL)
+        MPI_Comm_free(&graph->comm);
+    MPI_Comm_free(&graph->active_comm);
+    #ifdef SHM_HALO
+    MPI_Comm_free(&graph->active_node_comm);
+    #endif
+}
+
+void init_comm_graph(comm_graph_t *graph)
 {
     int i;
-    fluid_particle *p;
-    float h = params->tunable_params.smoothing_radius;
+
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &graph->rank);
+    MPI_Comm_size(MPI_COMM_COMPUTE, &graph->nprocs);
+    graph->render_host = on_render_host;
+
+    graph->comm = MPI_COMM_NULL;
+    graph->num_neighbors = 0;
+    graph->neighbor_ranks = malloc(graph->nprocs * sizeof(int));
+    graph->graph_ranks = malloc(graph->nprocs * sizeof(int));
+    graph->num_strips = STRIPS_PER_RANK * graph->nprocs;
+    graph->strip_owners = malloc(graph->num_strips * sizeof(int));
+    graph->occupied = malloc(graph->nprocs * graph->num_strips * sizeof(char));
+    graph->reach = malloc(graph->num_strips * sizeof(char));
+    graph->joining = malloc(graph->nprocs * sizeof(int));
+    graph->scratch = malloc((4*graph->nprocs + 3) * sizeof(int));
+    graph->join_requested = false;
+
+    #ifdef SHM_HALO
+    // Ranks on the same host can read each others particles directly
+    MPI_Comm_split_type(MPI_COMM_COMPUTE, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &graph->node_comm);
+    graph->node_ranks = malloc(graph->nprocs * sizeof(int));
+    #endif
+
+    // All compute ranks start out taking part
+    graph->members = malloc(graph->nprocs * sizeof(int));
+    graph->active_ranks = malloc(graph->nprocs * sizeof(int));
+    graph->num_members = graph->nprocs;
+    for(i=0; i<graph->nprocs; i++)
+        graph->members[i] = i;
+    create_active_comm(graph);
+}
+
+void free_comm_graph(comm_graph_t *graph)
+{
+    if(graph->active_comm != MPI_COMM_NULL)
+        free_active_comm(graph);
+
+    free(graph->neighbor_ranks);
+    free(graph->graph_ranks);
+    free(graph->strip_owners);
+    free(graph->occupied);
+    free(graph->reach);
+    free(graph->joining);
+    free(graph->scratch);
+    free(graph->members);
+    free(graph->active_ranks);
+
+    #ifdef SHM_HALO
+    MPI_Comm_free(&graph->node_comm);
+    free(graph->node_ranks);
+    #endif
+}
+
+#ifdef SHM_HALO
+// Allocate particle storage in a window shared by all compute ranks on this host
+// Following the particles is space for the indicies of this ranks edge particles
+fluid_particle *create_shared_particles(edge_t *edges, comm_graph_t *graph, int max_fluid_particles_local)
+{
+    int i, node_size, disp_unit;
+    MPI_Aint segment_size;
+    char *base;
+
+    MPI_Comm_size(graph->node_comm, &node_size);
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+
+    size_t particle_bytes = max_fluid_particles_local * sizeof(fluid_particle);
+    size_t bytes = particle_bytes + (max_fluid_particles_local+1) * sizeof(int);
+    MPI_Win_allocate_shared(bytes, 1, info, graph->node_comm, &base, &edges->win);
+    MPI_Info_free(&info);
+
+    // Lookup particles and edge indicies of every rank on this host
+    edges->node_particles = malloc(node_size * sizeof(fluid_particle*));
+    edges->node_edge_indicies = malloc(node_size * sizeof(int*));
+    for(i=0; i<node_size; i++) {
+        MPI_Win_shared_query(edges->win, i, &segment_size, &disp_unit, &base);
+        edges->node_particles[i] = (fluid_particle*)base;
+        edges->node_edge_indicies[i] = (int*)(base + particle_bytes);
+    }
+
+    // Passive target epoch for the lifetime of the window, synchronized with MPI_Win_sync
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, edges->win);
+
+    int node_rank;
+    MPI_Comm_rank(graph->node_comm, &node_rank);
+    edges->node_edge_indicies[node_rank][0] = 0;
+    edges->number_shared_halo_particles = 0;
+
+    return edges->node_particles[node_rank];
+}
+
+void free_shared_particles(edge_t *edges)
+{
+    MPI_Win_unlock_all(edges->win);
+    MPI_Win_free(&edges->win);
+    free(edges->node_particles);
+    free(edges->node_edge_indicies);
+}
+
+// Make stores to the shared window visible to, and wait on, all ranks on this host taking part
+static void sync_shared_particles(edge_t *edges, comm_graph_t *graph)
+{
+    MPI_Win_sync(edges->win);
+    MPI_Barrier(graph->active_node_comm);
+    MPI_Win_sync(edges->win);
+}
+#endif
+
+static int read_param_version(param_channel_t *channel);
+static bool frame_buffer_released(frame_window_t *frame_window);
+
+// Receive one parameter version from the render node
+// Compute ranks balance partitions themselves so this ranks partition is kept
+static void recv_params(tunable_parameters *params)
+{
+    float node_start_x = params->node_start_x;
+    float node_end_x = params->node_end_x;
+
+    MPI_Recv(params, 1, TunableParamtype, 0, PARAM_TAG, MPI_COMM_SIM, MPI_STATUS_IGNORE);
+
+    params->node_start_x = node_start_x;
+    params->node_end_x = node_end_x;
+}
+
+// Receive parameter versions up to version, the render node sent each version to all compute ranks at once
+static void catch_up_params(param_channel_t *channel, tunable_parameters *params, int version)
+{
+    while(channel->version < version) {
+        recv_params(params);
+        channel->version++;
+    }
+}
+
+// Create active_comm from the member list and agree on parameters and strips with ranks that have just joined
+// Joining ranks kept receiving parameters while idle so they may be ahead of, or behind, the other members
+static void join_active_comm(comm_graph_t *graph, param_channel_t *channel, tunable_parameters *params)
+{
+    int version;
+
+    create_active_comm(graph);
+
+    // Strips were rebalanced while joining ranks idled, the lead is always a member
+    MPI_Bcast(graph->strip_owners, graph->num_strips, MPI_INT, 0, graph->active_comm);
+
+    MPI_Allreduce(&channel->version, &version, 1, MPI_INT, MPI_MAX, graph->active_comm);
+    catch_up_params(channel, params, version);
+}
+
+// Apply the newest parameters from the render node, let ranks that are inactive and hold no particles leave the simulation,
+// and idle ranks that have asked rejoin it
+// Members agree on the newest parameter version any has seen published, so all apply the same parameters
+// Inactive ranks stay until the particles they held have moved to their new owners
+// Collective over graph->active_comm, returns false on ranks that have left
+bool update_active_ranks(comm_graph_t *graph, param_channel_t *channel, param *params, frame_window_t *frame_window)
+{
+    int i, j, flag;
+    MPI_Status status;
 
     int rank;
     MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
-    int nprocs;
-    MPI_Comm_size(MPI_COMM_COMPUTE, &nprocs);
 
-    // Set edge particle indicies and update number
-    edges->number_edge_particles_left = 0;
-    edges->number_edge_particles_right = 0;
-    for(i=0; i<params->number_fluid_particles_local; i++)
-    {
-        p = fluid_particle_pointers[i];
-        if (p->x - params->tunable_params.node_start_x <= h)
-            edges->edge_pointers_left[edges->number_edge_particles_left++] = p;
-        else if (params->tunable_params.node_end_x - p->x <= h)
-            edges->edge_pointers_right[edges->number_edge_particles_right++] = p;
+    // Each member sends whether it's staying and the parameter version it has seen, the lead also sends the number of ranks asking to join
+    // and whether every render rank has released the buffer this frame goes into
+    int local[4];
+    local[0] = rank == LEAD_RANK || params->tunable_params.active || params->number_fluid_particles_local > 0;
+    local[1] = 0;
+    local[2] = read_param_version(channel);
+    local[3] = 0;
+    if(rank == LEAD_RANK) {
+        local[3] = frame_buffer_released(frame_window);
+        while(1) {
+            MPI_Iprobe(MPI_ANY_SOURCE, JOIN_TAG, MPI_COMM_COMPUTE, &flag, &status);
+            if(!flag)
+                break;
+            MPI_Recv(NULL, 0, MPI_BYTE, status.MPI_SOURCE, JOIN_TAG, MPI_COMM_COMPUTE, MPI_STATUS_IGNORE);
+            graph->joining[local[1]++] = status.MPI_SOURCE;
+        }
     }
 
-    int num_moving_left = edges->number_edge_particles_left;
-    int num_moving_right = edges->number_edge_particles_right;
+    int *gathered = graph->scratch;
+    MPI_Allgather(local, 4, MPI_INT, gathered, 4, MPI_INT, graph->active_comm);
 
-    // Setup nodes to left and right of self
-    int proc_to_left =  (rank == 0 ? MPI_PROC_NULL : rank-1);
-    int proc_to_right = (rank == nprocs-1 ? MPI_PROC_NULL : rank+1);
+    // Versions up to the newest were sent to every compute rank before it was published
+    int version = 0;
+    for(i=0; i<graph->num_members; i++) {
+        if(gathered[4*i+2] > version)
+            version = gathered[4*i+2];
+    }
+    catch_up_params(channel, &params->tunable_params, version);
+
+    // The lead is always active_comm rank 0
+    frame_window->deliver = gathered[3];
+    int num_joining = gathered[1];
+    bool changed = num_joining > 0;
+    for(i=0; i<graph->num_members; i++) {
+        if(!gathered[4*i])
+            changed = true;
+    }
+    if(!changed)
+        return true;
+
+    if(num_joining)
+        MPI_Bcast(graph->joining, num_joining, MPI_INT, 0, graph->active_comm);
+
+    // Members are kept in compute rank order so the lead remains active_comm rank 0
+    bool member;
+    int num_members = 0;
+    for(i=0; i<graph->nprocs; i++) {
+        member = graph->active_ranks[i] >= 0 && gathered[4*graph->active_ranks[i]];
+        for(j=0; j<num_joining && !member; j++)
+            member = graph->joining[j] == i;
+        if(member)
+            graph->members[num_members++] = i;
+    }
+    graph->num_members = num_members;
 
-    debug_print("rank %d, halo: will send %d to left, %d to right\n", rank, num_moving_left, num_moving_right);
+    // The graph is rebuilt by the new members
+    free_active_comm(graph);
+    graph->num_neighbors = 0;
 
-    // Get number of halo particles from right and left
-    int num_from_left = 0;
-    int num_from_right = 0;
-    int tag = 3217;
+    if(!local[0]) {
+        debug_print("rank %d leaving simulation\n", rank);
+        return false;
+    }
 
-    // Send number to right and receive from left
-    MPI_Sendrecv(&num_moving_right, 1, MPI_INT, proc_to_right, tag, &num_from_left,1,MPI_INT,proc_to_left,tag,MPI_COMM_COMPUTE, MPI_STATUS_IGNORE);
-    // Send number to left and receive from right
-    tag = 8425;
-    MPI_Sendrecv(&num_moving_left, 1, MPI_INT, proc_to_left, tag, &num_from_right,1,MPI_INT,proc_to_right,tag,MPI_COMM_COMPUTE, MPI_STATUS_IGNORE);
+    // Wake joining ranks with the frame they join at, whether it's delivered, and the new member list
+    if(rank == LEAD_RANK) {
+        int *wake = graph->scratch;
+        wake[0] = frame_window->frame;
+        wake[1] = num_members;
+        wake[2] = frame_window->deliver;
+        memcpy(&wake[3], graph->members, num_members * sizeof(int));
+        for(j=0; j<num_joining; j++)
+            MPI_Send(wake, 3 + num_members, MPI_INT, graph->joining[j], WAKE_TAG, MPI_COMM_COMPUTE);
+    }
 
-    debug_print("rank %d, halo: will recv %d from left, %d from right\n", rank, num_from_left, num_from_right);
+    join_active_comm(graph, channel, &params->tunable_params);
 
+    debug_print("rank %d, %d ranks taking part\n", rank, num_members);
 
-    int *blocklens_left = (int*)malloc(num_moving_left * sizeof(int));
-    int *blocklens_right = (int*)malloc(num_moving_right * sizeof(int));
-    int *indicies_left = (int*)malloc(num_moving_left * sizeof(int));
-    int *indicies_right = (int*)malloc(num_moving_right * sizeof(int));
+    return true;
+}
 
-    // Convert the edge pointer into a particle array index using pointer arithmetic
-    int index;
-    int edge_global_index; // Should perhaps use ptrdiff_t
-    for (i=0; i<num_moving_left; i++) {
-        blocklens_left[i] = 1;
-        edge_global_index = (int) (edges->edge_pointers_left[i] - fluid_particles);
-        indicies_left[i]  = edge_global_index;
+// Block cheaply on a rank that has left the simulation until the lead wakes it
+// Parameters are still received, once made active again the rank asks the lead to rejoin
+// Returns false if the simulation has ended
+bool wait_while_idle(comm_graph_t *graph, param_channel_t *channel, tunable_parameters *params, frame_window_t *frame_window)
+{
+    int flag;
+    int *wake = graph->scratch;
+    struct timespec interval = {0, IDLE_INTERVAL_US * 1000};
+
+    while(!params->kill_sim) {
+        MPI_Iprobe(LEAD_RANK, WAKE_TAG, MPI_COMM_COMPUTE, &flag, MPI_STATUS_IGNORE);
+        if(flag)
+            break;
+
+        catch_up_params(channel, params, read_param_version(channel));
+        if(params->active && !graph->join_requested) {
+            MPI_Send(NULL, 0, MPI_BYTE, LEAD_RANK, JOIN_TAG, MPI_COMM_COMPUTE);
+            graph->join_requested = true;
+        }
+
+        nanosleep(&interval, NULL);
     }
-    for (i=0; i<num_moving_right; i++) {
-        blocklens_right[i] = 1;
-        edge_global_index = (int) (edges->edge_pointers_right[i] - fluid_particles);
-        indicies_right[i]  = edge_global_index;
+
+    // The lead answers every idle rank, with an empty member list once the simulation has ended
+    MPI_Recv(wake, 3 + graph->nprocs, MPI_INT, LEAD_RANK, WAKE_TAG, MPI_COMM_COMPUTE, MPI_STATUS_IGNORE);
+    if(!wake[1])
+        return false;
+
+    graph->join_requested = false;
+    frame_window->frame = wake[0];
+    graph->num_members = wake[1];
+    frame_window->deliver = wake[2];
+    memcpy(graph->members, &wake[3], graph->num_members * sizeof(int));
+
+    join_active_comm(graph, channel, params);
+
+    return true;
+}
+
+// Tell idle ranks the simulation has ended and match join requests the lead never answered
+// Collective over MPI_COMM_COMPUTE
+void release_idle_ranks(comm_graph_t *graph)
+{
+    int i, rank, pending;
+    int done[2] = {0, 0};
+
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+
+    if(rank == LEAD_RANK) {
+        for(i=0; i<graph->nprocs; i++) {
+            if(graph->active_ranks[i] < 0)
+                MPI_Send(done, 2, MPI_INT, i, WAKE_TAG, MPI_COMM_COMPUTE);
+        }
     }
 
-    MPI_Type_indexed(num_moving_left,blocklens_left,indicies_left,Particletype,&LeftEdgetype);
-    MPI_Type_commit(&LeftEdgetype);
-    MPI_Type_indexed(num_moving_right,blocklens_right,indicies_right,Particletype,&RightEdgetype);
-    MPI_Type_commit(&RightEdgetype);
+    int requested = graph->join_requested;
+    MPI_Reduce(&requested, &pending, 1, MPI_INT, MPI_SUM, LEAD_RANK, MPI_COMM_COMPUTE);
 
-    debug_print("rank %d, prams->max_fluid_particle_index: %d\n", rank,  params->max_fluid_particle_index);
+    if(rank == LEAD_RANK) {
+        for(i=0; i<pending; i++)
+            MPI_Recv(NULL, 0, MPI_BYTE, MPI_ANY_SOURCE, JOIN_TAG, MPI_COMM_COMPUTE, MPI_STATUS_IGNORE);
+    }
+}
 
-    //Index to start receiving halo particles
-    int indexToReceiveLeft = params->max_fluid_particle_index + 1;
-    int indexToReceiveRight = indexToReceiveLeft + num_from_left;
+// Split the world into strips and give each to the member whose partition holds its center
+// Partitions start out contiguous, as placed by partitionProblem or a checkpoint, balancing may scatter them
+// Collective over graph->active_comm
+void init_strips(comm_graph_t *graph, AABB_t *boundary_global, param *params)
+{
+    int i, s;
+    float center;
+
+    graph->strip_min_x = boundary_global->min_x;
+    graph->strip_width = (boundary_global->max_x - boundary_global->min_x)/graph->num_strips;
+
+    float edges[2];
+    edges[0] = params->tunable_params.node_start_x;
+    edges[1] = params->tunable_params.node_end_x;
+    float *gathered = malloc(2 * graph->num_members * sizeof(float));
+    MPI_Allgather(edges, 2, MPI_FLOAT, gathered, 2, MPI_FLOAT, graph->active_comm);
+
+    for(s=0; s<graph->num_strips; s++) {
+        center = graph->strip_min_x + (s + 0.5f)*graph->strip_width;
+        graph->strip_owners[s] = -1;
+        for(i=0; i<graph->num_members; i++) {
+            if(center >= gathered[2*i] && center < gathered[2*i+1])
+                graph->strip_owners[s] = graph->members[i];
+        }
+    }
 
-    debug_print("rank %d, halo: send %d to left, %d to right, indexToRecieveLeft %d, indexToReceiveRight %d \n", rank, num_moving_left, num_moving_right, indexToReceiveLeft, indexToReceiveRight);
+    // Strips not covered by any partition go to the rank owning the strip before, or after, them
+    for(s=1; s<graph->num_strips; s++) {
+        if(graph->strip_owners[s] < 0)
+            graph->strip_owners[s] = graph->strip_owners[s-1];
+    }
+    for(s=graph->num_strips-2; s>=0; s--) {
+        if(graph->strip_owners[s] < 0)
+            graph->strip_owners[s] = graph->strip_owners[s+1];
+    }
 
-    int tagl = 4312;
-    int tagr = 5177;
-    // Receive halo from left rank
-    MPI_Irecv(&fluid_particles[indexToReceiveLeft], num_from_left, Particletype, proc_to_left,tagl, MPI_COMM_COMPUTE, &edges->reqs[0]);
-    // Receive halo from right rank
-    MPI_Irecv(&fluid_particles[indexToReceiveRight], num_from_right, Particletype, proc_to_right,tagr, MPI_COMM_COMPUTE, &edges->reqs[1]);
-    // Send halo to right rank
-    MPI_Isend(fluid_particles,1,RightEdgetype,proc_to_right,tagl,MPI_COMM_COMPUTE, &edges->reqs[2]);
-    MPI_Isend(fluid_particles,1,LeftEdgetype,proc_to_left,tagr,MPI_COMM_COMPUTE, &edges->reqs[3]);
+    free(gathered);
+}
 
-    // Free allocated arays
-    free(blocklens_left);
-    free(blocklens_right);
-    free(indicies_left);
-    free(indicies_right);
+// Return the strip holding x, positions outside of the world are in the first or last strip
+int strip_index(comm_graph_t *graph, float x)
+{
+    int s = (x - graph->strip_min_x)/graph->strip_width;
+    return s < 0 ? 0 : (s >= graph->num_strips ? graph->num_strips-1 : s);
 }
 
-void finishHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, param *params)
+// Gather the strips every member holds particles in and rebuild the distributed graph if the set of
+// members within h of this rank has changed. Collective over graph->active_comm
+void update_comm_graph(fluid_particle **fluid_particle_pointers, comm_graph_t *graph, param *params)
 {
-    int i;
-    // Wait for transfer to complete
-    MPI_Status statuses[4];
-    MPI_Waitall(4, edges->reqs, statuses);
+    int i, s, t, member;
+    int num_strips = graph->num_strips;
+    int rank = graph->rank;
+    char *reach = graph->reach;
+
+    // A rank holding particles outside of its strips, such as an inactive rank or one whose strips were just
+    // given away, also reaches those so the ranks now owning them are neighbors
+    memset(reach, 0, num_strips);
+    for(i=0; i<params->number_fluid_particles_local; i++)
+        reach[strip_index(graph, fluid_particle_pointers[i]->x)] = 1;
+    MPI_Allgather(reach, num_strips, MPI_CHAR, graph->occupied, num_strips, MPI_CHAR, graph->active_comm);
+
+    // Strips within h of a strip this rank owns or holds particles in
+    // A strip k strips away is (k-1)*strip_width from it
+    int k = params->tunable_params.smoothing_radius/graph->strip_width + 1;
+    char *occupied = graph->occupied + graph->active_ranks[rank]*num_strips;
+    for(s=0; s<num_strips; s++) {
+        reach[s] = 0;
+        for(t=max(s-k, 0); t<=min(s+k, num_strips-1) && !reach[s]; t++)
+            reach[s] = graph->strip_owners[t] == rank || occupied[t];
+    }
+
+    // Any member owning or holding particles in a strip this rank reaches is a neighbor
+    // Reach is symmetric so sources and destinations are the same set
+    int num_neighbors = 0;
+    bool changed = (graph->comm == MPI_COMM_NULL);
+    bool neighbor;
+    for(i=0; i<graph->num_members; i++) {
+        member = graph->members[i];
+        if(member == rank)
+            continue;
+        occupied = graph->occupied + i*num_strips;
+        neighbor = false;
+        for(s=0; s<num_strips && !neighbor; s++)
+            neighbor = reach[s] && (graph->strip_owners[s] == member || occupied[s]);
+        if(neighbor) {
+            if(num_neighbors >= graph->num_neighbors || graph->neighbor_ranks[num_neighbors] != member)
+                changed = true;
+            graph->neighbor_ranks[num_neighbors] = member;
+            graph->graph_ranks[num_neighbors] = i;
+            num_neighbors++;
+        }
+    }
+    if(num_neighbors != graph->num_neighbors)
+        changed = true;
+    graph->num_neighbors = num_neighbors;
+
+    // Rebuilding is collective so every rank must agree it's required
+    MPI_Allreduce(MPI_IN_PLACE, &changed, 1, MPI_C_BOOL, MPI_LOR, graph->active_comm);
+    if(!changed)
+        return;
+
+    if(graph->comm != MPI_COMM_NULL)
+        MPI_Comm_free(&graph->comm);
+
+    MPI_Dist_graph_create_adjacent(graph->active_comm, num_neighbors, graph->graph_ranks, MPI_UNWEIGHTED,
+                                   num_neighbors, graph->graph_ranks, MPI_UNWEIGHTED, MPI_INFO_NULL, 0, &graph->comm);
+
+    #ifdef SHM_HALO
+    // Find which neighbors share this host
+    MPI_Group node_group;
+    MPI_Comm_group(graph->node_comm, &node_group);
+    MPI_Group_translate_ranks(group_compute, num_neighbors, graph->neighbor_ranks, node_group, graph->node_ranks);
+    MPI_Group_free(&node_group);
+    #endif
+
+    debug_print("rank %d, graph: %d neighbors\n", rank, num_neighbors);
+}
 
-    int num_received_right = 0;
-    int num_received_left = 0;
-    MPI_Get_count(&statuses[0], Particletype, &num_received_left);
-    MPI_Get_count(&statuses[1], Particletype, &num_received_right);
+// Return the graph index of compute rank, -1 if it isn't a neighbor
+static int neighbor_index(comm_graph_t *graph, int rank)
+{
+    int n;
+    for(n=0; n<graph->num_neighbors; n++) {
+        if(graph->neighbor_ranks[n] == rank)
+            return n;
+    }
+    return -1;
+}
 
-    int total_received = num_received_left + num_received_right;
-    params->number_halo_particles = total_received;
+// Return the graph index of the neighbor owning position x
+// If x is owned by a rank that isn't a neighbor the neighbor owning the closest strip is used, the particle will continue on from there
+static int owning_neighbor(comm_graph_t *graph, float x)
+{
+    int d, n;
+    int s = strip_index(graph, x);
+
+    for(d=0; d<graph->num_strips; d++) {
+        if(s-d >= 0 && (n = neighbor_index(graph, graph->strip_owners[s-d])) >= 0)
+            return n;
+        if(s+d < graph->num_strips && (n = neighbor_index(graph, graph->strip_owners[s+d])) >= 0)
+            return n;
+    }
 
-    // Need to automatically add rank to debug print
-    debug_print("halo: recv %d from left, %d from right\n",num_received_left,num_received_right);
+    return -1;
+}
+
+// Return true if x is in one of this ranks strips
+static bool in_partition(comm_graph_t *graph, float x)
+{
+    return graph->strip_owners[strip_index(graph, x)] == graph->rank;
+}
+
+// Convert counts into displacements, returning the total count
+static int counts_to_displs(int *counts, int *displs, int num)
+{
+    int n, total = 0;
+    for(n=0; n<num; n++) {
+        displs[n] = total;
+        total += counts[n];
+    }
+    return total;
+}
+
+// Return true if x is within width of a ranks partition
+static bool near_partition(comm_graph_t *graph, float x, int rank, float width)
+{
+    int s;
+    int last = strip_index(graph, x + width);
+    for(s=strip_index(graph, x - width); s<=last; s++) {
+        if(graph->strip_owners[s] == rank)
+            return true;
+    }
+    return false;
+}
+
+// Return true if particle is within width of a ranks partition
+static bool in_halo(fluid_particle *p, comm_graph_t *graph, int rank, float width)
+{
+    return near_partition(graph, p->x, rank, width);
+}
 
-    // Update pointer array with new values
+// Return true if graph neighbor n reads halo particles through the shared window
+static bool on_host(comm_graph_t *graph, int n)
+{
+    #ifdef SHM_HALO
+    return graph->node_ranks[n] != MPI_UNDEFINED;
+    #else
+    (void)graph;
+    (void)n;
+    return false;
+    #endif
+}
+
+// Abort if a rank is sent more particles than the room left in its particle array
+static void check_particle_room(int needed, int room)
+{
+    if(needed > room) {
+        int rank;
+        MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+        printf("Rank %d is sent %d particles but has room for %d, raise the scene capacity\n", rank, needed, room);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+}
+
+#ifdef SHM_HALO
+// Publish indicies of particles staying on this rank that are within width of a same host neighbor
+// then copy same host neighbors published particles that are within width of this partition into halo,
+// which has room for max_halo particles
+// Halo particles are copied rather than read in place: their ids are set to index this ranks neighbor lists,
+// hash_halo adds to their densities, and relaxation displaces them, while the owner goes on moving its own.
+// The second barrier keeps owners from doing so until every rank on the host has copied them
+// Returns the number of particles copied
+static int exchange_shared_halo(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, int *destinations,
+                                fluid_particle *halo, int max_halo, edge_t *edges, comm_graph_t *graph, float width, param *params)
+{
+    int i, n, node_neighbor;
+    fluid_particle *p;
+
+    int rank, node_rank;
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+    MPI_Comm_rank(graph->node_comm, &node_rank);
+
+    int *edge_indicies = edges->node_edge_indicies[node_rank];
+    int num_edge = 0;
+    for(i=0; i<params->number_fluid_particles_local; i++) {
+        if(destinations && destinations[i] >= 0)
+            continue;
+        p = fluid_particle_pointers[i];
+        for(n=0; n<graph->num_neighbors; n++) {
+            if(on_host(graph, n) && in_halo(p, graph, graph->neighbor_ranks[n], width)) {
+                edge_indicies[1 + num_edge++] = (int)(p - fluid_particles);
+                break;
+            }
+        }
+    }
+    edge_indicies[0] = num_edge;
+    sync_shared_particles(edges, graph);
+
+    fluid_particle *node_particles;
+    int *node_edge_indicies;
+    int num_copied = 0;
+    for(n=0; n<graph->num_neighbors; n++) {
+        if(!on_host(graph, n))
+            continue;
+        node_neighbor = graph->node_ranks[n];
+        node_particles = edges->node_particles[node_neighbor];
+        node_edge_indicies = edges->node_edge_indicies[node_neighbor];
+        for(i=0; i<node_edge_indicies[0]; i++) {
+            p = &node_particles[node_edge_indicies[1+i]];
+            if(in_halo(p, graph, rank, width)) {
+                check_particle_room(num_copied + 1, max_halo);
+                halo[num_copied++] = *p;
+            }
+        }
+    }
+
+    // Neighbors may not modify their particles until all ranks on this host are done copying
+    sync_shared_particles(edges, graph);
+
+    return num_copied;
+}
+#endif
+
+// Set pointers to halo particles placed after max_fluid_particle_index
+static void set_halo_pointers(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, int number_halo, param *params)
+{
+    int i;
     int local_index;
     int global_index;
-    for (i=0; i< total_received; i++) {
+
+    params->number_halo_particles = number_halo;
+
+    for (i=0; i<number_halo; i++) {
         local_index = params->number_fluid_particles_local + i;
         global_index = params->max_fluid_particle_index + 1 + i;
         fluid_particle_pointers[local_index] = &fluid_particles[global_index];
         fluid_particle_pointers[local_index]->id = local_index;
     }
+}
 
-    // Free indexed types
-    MPI_Type_free(&LeftEdgetype);
-    MPI_Type_free(&RightEdgetype);
+// Particles may have moved past this ranks partition since they were last transferred
+// so halo particles are gathered from a slightly larger region
+static float halo_width(param *params)
+{
+    return params->tunable_params.smoothing_radius + MAX_VELOCITY * params->tunable_params.time_step;
 }
 
-// Transfer particles that are out of node bounds
-void transferOOBParticles(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, param *params)
+void startHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, comm_graph_t *graph, param *params)
 {
-    int i;
+    int i, n;
     fluid_particle *p;
+    float width = halo_width(params);
+    int num_neighbors = graph->num_neighbors;
 
-    int rank;
-    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
-    int nprocs;
-    MPI_Comm_size(MPI_COMM_COMPUTE, &nprocs);
-
-    int num_moving_left = out_of_bounds->number_oob_particles_left;
-    int num_moving_right = out_of_bounds->number_oob_particles_right;
-
-    // Setup nodes to left and right of self
-    int proc_to_left =  (rank == 0 ? MPI_PROC_NULL : rank-1);
-    int proc_to_right = (rank == nprocs-1 ? MPI_PROC_NULL : rank+1);
-
-    // Get number of particles from right and left
-    int num_from_left = 0;
-    int num_from_right = 0;
-    int tag = 7006;
-    // Send number to right and receive from left
-    MPI_Sendrecv(&num_moving_right, 1, MPI_INT, proc_to_right, tag, &num_from_left,1,MPI_INT,proc_to_left,tag,MPI_COMM_COMPUTE,MPI_STATUS_IGNORE);
-    // Send number to left and receive from right
-    tag = 8278;
-    MPI_Sendrecv(&num_moving_left, 1, MPI_INT, proc_to_left, tag, &num_from_right,1,MPI_INT,proc_to_right,tag,MPI_COMM_COMPUTE,MPI_STATUS_IGNORE);
-
-    // Create indexed type to send
-    MPI_Datatype LeftMovetype;
-    MPI_Datatype RightMovetype;
-    int *blocklens_left = malloc(num_moving_left*sizeof(int));
-    int *blocklens_right = malloc(num_moving_right*sizeof(int));
-    int *indicies_left = malloc(num_moving_left*sizeof(int));
-    int *indicies_right = malloc(num_moving_right*sizeof(int));
-
-    // Convert the OOB pointer into a particle array index using pointer arithmetic
-    int index;
-    int oob_global_index;
-    for (i=0; i<num_moving_left; i++) {
-        blocklens_left[i] = 1;
-        index = out_of_bounds->oob_pointer_indicies_left[i];
-        oob_global_index = (int) (fluid_particle_pointers[index] - fluid_particles);
-        indicies_left[i]  = oob_global_index;
-    }
-    for (i=0; i<num_moving_right; i++) {
-        blocklens_right[i] = 1;
-        index = out_of_bounds->oob_pointer_indicies_right[i];
-        oob_global_index = (int) (fluid_particle_pointers[index] - fluid_particles);
-        indicies_right[i]  = oob_global_index;
-    }
-
-    MPI_Type_indexed(num_moving_left,blocklens_left,indicies_left,Particletype,&LeftMovetype);
-    MPI_Type_commit(&LeftMovetype);
-    MPI_Type_indexed(num_moving_right,blocklens_right,indicies_right,Particletype,&RightMovetype);
-    MPI_Type_commit(&RightMovetype);
-
-    // Create indexed type to recv
-    MPI_Datatype LeftRecvtype;
-    MPI_Datatype RightRecvtype;
-
-    int total_recv = num_from_left + num_from_right;
-    int *blocklens_recv = malloc(total_recv*sizeof(int));
-    int *indicies_recv = malloc(total_recv*sizeof(int));
-    // Go through vacancies, starting at end, to create receive indicies
-    // Go through reverse so it's easy to set update vacancies below
-    for (i=0; i<out_of_bounds->number_vacancies && i<total_recv; i++) {
-        blocklens_recv[i] = 1;
-        index = out_of_bounds->number_vacancies-1-i;
-        indicies_recv[i] = out_of_bounds->vacant_indicies[index];
-    }
-    int replaced = i;
-    int remaining = total_recv - replaced;
-    for (i=0; i<remaining; i++) {
-        blocklens_recv[replaced+i] = 1;
-        indicies_recv[replaced+i] = params->max_fluid_particle_index + 1 + i;
-    }
-
-    MPI_Type_indexed(num_from_left, blocklens_recv, indicies_recv, Particletype, &LeftRecvtype);
-    MPI_Type_commit(&LeftRecvtype);
-    MPI_Type_indexed(num_from_right, &blocklens_recv[num_from_left],&indicies_recv[num_from_left], Particletype, &RightRecvtype);
-    MPI_Type_commit(&RightRecvtype); 
+    // Count particles within range of each neighbors partition
+    for(n=0; n<num_neighbors; n++)
+        edges->send_counts[n] = 0;
+    for(i=0; i<params->number_fluid_particles_local; i++) {
+        p = fluid_particle_pointers[i];
+        for(n=0; n<num_neighbors; n++) {
+            if(!on_host(graph, n) && in_halo(p, graph, graph->neighbor_ranks[n], width))
+                edges->send_counts[n]++;
+        }
+    }
 
-    MPI_Status status;
-    MPI_Request request;
+    int num_sending = counts_to_displs(edges->send_counts, edges->send_displs, num_neighbors);
+    if(num_sending > edges->max_edge_particles) {
+        edges->max_edge_particles = num_sending;
+        edges->send_particles = realloc(edges->send_particles, num_sending * sizeof(fluid_particle));
+    }
 
-    // Send oob particles to right processor receive oob particles from right processor
-    int num_received_left = 0;
-    int num_received_right = 0;
+    // Pack particles grouped by neighbor, send_counts is reused as a cursor
+    // The position each edge particle is sent from is kept to decide when the halo must be refreshed
+    bool edge;
+    int num_edge = 0;
+    for(n=0; n<num_neighbors; n++)
+        edges->send_counts[n] = 0;
+    for(i=0; i<params->number_fluid_particles_local; i++) {
+        p = fluid_particle_pointers[i];
+        edge = false;
+        for(n=0; n<num_neighbors; n++) {
+            if(!in_halo(p, graph, graph->neighbor_ranks[n], width))
+                continue;
+            edge = true;
+            if(!on_host(graph, n))
+                edges->send_particles[edges->send_displs[n] + edges->send_counts[n]++] = *p;
+        }
+        if(edge) {
+            edges->edge_indicies[num_edge] = i;
+            edges->edge_positions[2*num_edge] = p->x;
+            edges->edge_positions[2*num_edge+1] = p->y;
+            num_edge++;
+        }
+    }
+    edges->number_edge_particles = num_edge;
 
-    // Sending to right, recv from left
-    tag = 2522;
-    MPI_Sendrecv(fluid_particles,1,RightMovetype,proc_to_right,tag,fluid_particles,1,LeftRecvtype,proc_to_left,tag,MPI_COMM_COMPUTE,&status);
-    MPI_Get_count(&status, Particletype, &num_received_left);
-    // Sending to left, recv from right
-    tag = 1165;
-    MPI_Sendrecv(fluid_particles,1,LeftMovetype,proc_to_left,tag,fluid_particles,1,RightRecvtype,proc_to_right,tag,MPI_COMM_COMPUTE,&status);
-    MPI_Get_count(&status, Particletype, &num_received_right);
+    // Get number of halo particles from each neighbor
+    MPI_Neighbor_alltoall(edges->send_counts, 1, MPI_INT, edges->recv_counts, 1, MPI_INT, graph->comm);
+    int num_receiving = counts_to_displs(edges->recv_counts, edges->recv_displs, num_neighbors);
+    memcpy(edges->halo_counts, edges->recv_counts, num_neighbors * sizeof(int));
 
-    int total_sent = num_moving_left + num_moving_right;
-    int total_received = num_received_right + num_received_left;
+    debug_print("halo: will send %d, recv %d\n", num_sending, num_receiving);
 
-    debug_print("rank %d OOB: sent left %d, right: %d recv left:%d, right: %d\n", rank, num_moving_left, num_moving_right, num_received_left, num_received_right);
+    //Index to start receiving halo particles
+    int index_to_receive = params->max_fluid_particle_index + 1;
+    check_particle_room(num_receiving, params->max_fluid_particles_local - index_to_receive);
+
+    MPI_Ineighbor_alltoallv(edges->send_particles, edges->send_counts, edges->send_displs, Particletype,
+                            &fluid_particles[index_to_receive], edges->recv_counts, edges->recv_displs, Particletype,
+                            graph->comm, &edges->req);
+
+    // Same host halo particles are placed after messaged halo particles
+    edges->number_shared_halo_particles = 0;
+    #ifdef SHM_HALO
+    edges->number_shared_halo_particles = exchange_shared_halo(fluid_particle_pointers, fluid_particles, NULL,
+                                                               &fluid_particles[index_to_receive + num_receiving],
+                                                               params->max_fluid_particles_local - index_to_receive - num_receiving,
+                                                               edges, graph, width, params);
+    #endif
+}
 
-    // Update maximum particle index if neccessary
-    int max_received_index = total_received?total_received-1:0;// If non received don't access indicies_recv[-1]...
-    if (total_received && indicies_recv[max_received_index] > params->max_fluid_particle_index) {
-        debug_print("rank %d increasing max index from: %d", rank, params->max_fluid_particle_index);
-        params->max_fluid_particle_index = indicies_recv[max_received_index];
-        debug_print("to %d\n", params->max_fluid_particle_index);
-    }
+void finishHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, comm_graph_t *graph, param *params)
+{
+    int i;
+    // Wait for transfer to complete
+    MPI_Wait(&edges->req, MPI_STATUS_IGNORE);
 
-    // Update vacancy total for particles received
-    if (total_received < out_of_bounds->number_vacancies )
-        out_of_bounds->number_vacancies -= total_received;
-    else
-        out_of_bounds->number_vacancies = 0;
-
-    // Update vacancy indicies and total for particles sent
-    // Set sent particle pointer to received particle location or to NULL
-    int oob_pointer_index;
-    int recv_replaced = 0; // received particles that have replaced leaving particles
-    for (i=0; i<num_moving_left; i++) {
-        // Index of particle pointer that has left
-        oob_pointer_index = out_of_bounds->oob_pointer_indicies_left[i];
-        // Index of particle that has left
-        oob_global_index = (int) (fluid_particle_pointers[oob_pointer_index] - fluid_particles);
-        out_of_bounds->vacant_indicies[out_of_bounds->number_vacancies] = oob_global_index;
-        // Incriment the number of vacancies
-        out_of_bounds->number_vacancies++;
-
-        // Set pointer from removed particle to a recvd particle ,if any, else NULL
-        if(recv_replaced < total_received) {
-            fluid_particle_pointers[oob_pointer_index] = &fluid_particles[indicies_recv[recv_replaced]]; 
-            recv_replaced++;
+    int total_received = edges->number_shared_halo_particles;
+    for(i=0; i<graph->num_neighbors; i++)
+        total_received += edges->recv_counts[i];
+
+    // Need to automatically add rank to debug print
+    debug_print("halo: recv %d\n", total_received);
+
+    set_halo_pointers(fluid_particle_pointers, fluid_particles, total_received, params);
+}
+
+// Decide, for each neighbor, whether the particle exchange with it takes place
+// A pair exchanges if either side has an edge particle that has moved more than halo_refresh_fraction*h since it was sent,
+// near the others partition, or an edge particle that has moved into the others partition
+// Only edge particles are checked, the others were further than the halo width from any other partition when the halo was sent
+// Returns true if this rank exchanges with any neighbor
+bool halo_refresh_needed(fluid_particle **fluid_particle_pointers, edge_t *edges, comm_graph_t *graph, param *params)
+{
+    int e, n;
+    fluid_particle *p;
+    float dx, dy;
+    float width = halo_width(params);
+    float max_displacement = params->tunable_params.halo_refresh_fraction * params->tunable_params.smoothing_radius;
+    float max_displacement_sq = max_displacement * max_displacement;
+    int num_neighbors = graph->num_neighbors;
+    bool *wanted = edges->refresh_wanted;
+
+    for(n=0; n<num_neighbors; n++)
+        wanted[n] = false;
+
+    for(e=0; e<edges->number_edge_particles; e++) {
+        p = fluid_particle_pointers[edges->edge_indicies[e]];
+        if(!in_partition(graph, p->x) && (n = owning_neighbor(graph, p->x)) >= 0)
+            wanted[n] = true;
+
+        dx = p->x - edges->edge_positions[2*e];
+        dy = p->y - edges->edge_positions[2*e+1];
+        if(dx*dx + dy*dy <= max_displacement_sq)
+            continue;
+        // Neighbors may hold a copy from where it was sent or need one where it is now
+        for(n=0; n<num_neighbors; n++) {
+            if(near_partition(graph, edges->edge_positions[2*e], graph->neighbor_ranks[n], width) || in_halo(p, graph, graph->neighbor_ranks[n], width))
+                wanted[n] = true;
         }
+    }
+
+    // Each neighbor learns whether this rank wants their exchange
+    MPI_Neighbor_alltoall(wanted, 1, MPI_C_BOOL, edges->refresh, 1, MPI_C_BOOL, graph->comm);
+
+    // Same host halo particles are copied by every rank on the host together, so the host decides as one
+    edges->refresh_shared = false;
+    #ifdef SHM_HALO
+    bool shared_wanted = false;
+    for(n=0; n<num_neighbors; n++) {
+        if(on_host(graph, n))
+            shared_wanted = shared_wanted || wanted[n];
+    }
+    MPI_Allreduce(&shared_wanted, &edges->refresh_shared, 1, MPI_C_BOOL, MPI_LOR, graph->active_node_comm);
+    #endif
+
+    bool refresh = edges->refresh_shared;
+    for(n=0; n<num_neighbors; n++) {
+        if(on_host(graph, n))
+            edges->refresh[n] = edges->refresh_shared;
         else
-            fluid_particle_pointers[oob_pointer_index] = NULL;
-    }
-    for (i=0; i<num_moving_right; i++) {
-        // Index of particle pointer that has left
-        oob_pointer_index = out_of_bounds->oob_pointer_indicies_right[i];
-        // Index of particle that has left
-        oob_global_index = (int) (fluid_particle_pointers[oob_pointer_index] - fluid_particles);
-        // Set new vacancy index
-        out_of_bounds->vacant_indicies[out_of_bounds->number_vacancies] = oob_global_index;
-        // Incriment the number of vacancies
-        out_of_bounds->number_vacancies++;
-
-        // Set pointer from removed particle to a recvd particle ,if any, else NULL
-        if(recv_replaced < total_received) {
-            fluid_particle_pointers[oob_pointer_index] = &fluid_particles[indicies_recv[recv_replaced]];
-            recv_replaced++;
+            edges->refresh[n] = edges->refresh[n] || wanted[n];
+        refresh = refresh || edges->refresh[n];
+    }
+
+    debug_print("halo refresh: shared %d, any %d\n", edges->refresh_shared, refresh);
+
+    return refresh;
+}
+
+// Send particles that have left this ranks partition, and halo particles, to each neighbor refreshed this step in a single message
+// Each message is preceded by a two integer header of the number of leaving and halo particles
+// Neighbors not refreshed keep the halo particles they sent in the last halo exchange, which relaxation has since moved
+// Leaving particles are removed before returning, the staying particles may be used until finishParticleExchange
+void startParticleExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, edge_t *edges, comm_graph_t *graph, param *params)
+{
+    int i, n, dest, pass;
+    fluid_particle *p;
+    float h = params->tunable_params.smoothing_radius;
+    int num_neighbors = graph->num_neighbors;
+    int *destinations = out_of_bounds->destinations;
+    int *send_header = edges->send_header;
+    bool *refresh = edges->refresh;
+
+    // Find the neighbor each particle that has left the partition is moving to
+    // Particles moving to a neighbor not refreshed this step stay until it is
+    out_of_bounds->number_oob_particles = 0;
+    for(i=0; i<params->number_fluid_particles_local; i++) {
+        p = fluid_particle_pointers[i];
+        destinations[i] = -1;
+        if(!in_partition(graph, p->x)) {
+            dest = owning_neighbor(graph, p->x);
+            if(dest >= 0 && refresh[dest]) {
+                destinations[i] = dest;
+                out_of_bounds->number_oob_particles++;
+            }
         }
-        else
-            fluid_particle_pointers[oob_pointer_index] = NULL;
     }
 
-    debug_print("rank %d OOB: num vacant %d\n", rank, out_of_bounds->number_vacancies);
+    // The first pass counts, the second packs each neighbors leaving particles followed by its halo particles
+    // A leaving particle is also a halo particle for any other neighbor it's near
+    for(pass=0; pass<2; pass++) {
+        for(n=0; n<num_neighbors; n++) {
+            send_header[2*n] = 0;
+            send_header[2*n+1] = 0;
+        }
 
-    // If more particles are received than sent add to end of pointer array
-    remaining = total_received - recv_replaced;
-    int pointer_index;
-    int global_index;
-    int max_fluid_pointers = params->number_fluid_particles_local;
-    for(i=0; i<remaining; i++)
-    {
-        pointer_index = params->number_fluid_particles_local + i;
-        global_index = indicies_recv[recv_replaced + i];
-        fluid_particle_pointers[pointer_index] = &fluid_particles[global_index];
-        max_fluid_pointers++;
+        for(i=0; i<params->number_fluid_particles_local; i++) {
+            p = fluid_particle_pointers[i];
+            dest = destinations[i];
+            if(dest >= 0) {
+                if(pass)
+                    edges->send_particles[edges->send_displs[dest] + send_header[2*dest]] = *p;
+                send_header[2*dest]++;
+            }
+        }
+
+        for(i=0; i<params->number_fluid_particles_local; i++) {
+            p = fluid_particle_pointers[i];
+            dest = destinations[i];
+            for(n=0; n<num_neighbors; n++) {
+                if(!refresh[n] || n == dest || (on_host(graph, n) && dest < 0))
+                    continue;
+                if(in_halo(p, graph, graph->neighbor_ranks[n], h)) {
+                    if(pass)
+                        edges->send_particles[edges->send_displs[n] + send_header[2*n] + send_header[2*n+1]] = *p;
+                    send_header[2*n+1]++;
+                }
+            }
+        }
+
+        for(n=0; n<num_neighbors; n++)
+            edges->send_counts[n] = send_header[2*n] + send_header[2*n+1];
+        if(!pass) {
+            int num_sending = counts_to_displs(edges->send_counts, edges->send_displs, num_neighbors);
+            if(num_sending > edges->max_edge_particles) {
+                edges->max_edge_particles = num_sending;
+                edges->send_particles = realloc(edges->send_particles, num_sending * sizeof(fluid_particle));
+            }
+        }
+    }
+
+    // Exchange headers with refreshed neighbors, the others send their last halo particles again as no leaving particles
+    int num_reqs = 0;
+    for(n=0; n<num_neighbors; n++) {
+        if(!refresh[n]) {
+            edges->recv_header[2*n] = 0;
+            edges->recv_header[2*n+1] = edges->halo_counts[n];
+            continue;
+        }
+        MPI_Irecv(&edges->recv_header[2*n], 2, MPI_INT, graph->graph_ranks[n], EXCHANGE_HEADER_TAG, graph->comm, &edges->reqs[num_reqs++]);
+        MPI_Isend(&send_header[2*n], 2, MPI_INT, graph->graph_ranks[n], EXCHANGE_HEADER_TAG, graph->comm, &edges->reqs[num_reqs++]);
+    }
+    MPI_Waitall(num_reqs, edges->reqs, MPI_STATUSES_IGNORE);
+
+    for(n=0; n<num_neighbors; n++)
+        edges->recv_counts[n] = edges->recv_header[2*n] + edges->recv_header[2*n+1];
+    int num_receiving = counts_to_displs(edges->recv_counts, edges->recv_displs, num_neighbors);
+
+    // The receive buffer has room for as many particles as the particle array
+    check_particle_room(num_receiving, params->max_fluid_particles_local);
+
+    debug_print("exchange: will send %d leaving, recv %d total\n", out_of_bounds->number_oob_particles, num_receiving);
+
+    num_reqs = 0;
+    for(n=0; n<num_neighbors; n++) {
+        if(!refresh[n])
+            continue;
+        if(edges->recv_counts[n])
+            MPI_Irecv(&edges->recv_particles[edges->recv_displs[n]], edges->recv_counts[n], Particletype,
+                      graph->graph_ranks[n], EXCHANGE_PARTICLE_TAG, graph->comm, &edges->reqs[num_reqs++]);
+        if(edges->send_counts[n])
+            MPI_Isend(&edges->send_particles[edges->send_displs[n]], edges->send_counts[n], Particletype,
+                      graph->graph_ranks[n], EXCHANGE_PARTICLE_TAG, graph->comm, &edges->reqs[num_reqs++]);
+    }
+    edges->num_reqs = num_reqs;
+
+    // Halo particles kept from neighbors not refreshed are still in place after the maximum index
+    fluid_particle *last_halo = &fluid_particles[params->max_fluid_particle_index + 1];
+    int last_displ = 0;
+    for(n=0; n<num_neighbors; n++) {
+        if(!refresh[n])
+            memcpy(&edges->recv_particles[edges->recv_displs[n]], &last_halo[last_displ], edges->halo_counts[n] * sizeof(fluid_particle));
+        last_displ += edges->halo_counts[n];
     }
 
-    // Update particle pointer array
-    // Go through all possible fluid particles and remove null entries
+    #ifdef SHM_HALO
+    if(edges->refresh_shared) {
+        edges->number_shared_halo_particles = exchange_shared_halo(fluid_particle_pointers, fluid_particles, destinations,
+                                                                   &edges->recv_particles[num_receiving],
+                                                                   params->max_fluid_particles_local - num_receiving,
+                                                                   edges, graph, h, params);
+    }
+    else {
+        check_particle_room(num_receiving + edges->number_shared_halo_particles, params->max_fluid_particles_local);
+        memcpy(&edges->recv_particles[num_receiving], &last_halo[last_displ], edges->number_shared_halo_particles * sizeof(fluid_particle));
+    }
+    #endif
+
+    // Vacate leaving particles, their values have been packed so the space may be reused once received particles arrive
+    // Staying particles are compacted to the front of the pointer array, so they may be hashed while the exchange completes
+    int index;
     int num_particles = 0;
-    for (i=0; i<max_fluid_pointers; i++) {
+    for(i=0; i<params->number_fluid_particles_local; i++) {
         p = fluid_particle_pointers[i];
-        if (p != NULL) {
-            fluid_particle_pointers[num_particles] = p;
+        if(destinations[i] >= 0) {
+            index = (int) (p - fluid_particles);
+            out_of_bounds->vacant_indicies[out_of_bounds->number_vacancies++] = index;
+            continue;
+        }
+        fluid_particle_pointers[num_particles] = p;
+        fluid_particle_pointers[num_particles]->id = num_particles;
+        num_particles++;
+    }
+    params->number_fluid_particles_local = num_particles;
+}
+
+// Take ownership of received particles, placed after the staying particles, and install received halo particles
+// Particles that have left remain as halo particles on this rank
+void finishParticleExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, edge_t *edges, comm_graph_t *graph, param *params)
+{
+    int i, n, index, start, end;
+    int num_neighbors = graph->num_neighbors;
+    float h = params->tunable_params.smoothing_radius;
+
+    int rank;
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+
+    // Wait for transfer to complete
+    MPI_Waitall(edges->num_reqs, edges->reqs, MPI_STATUSES_IGNORE);
+
+    // Received particles fill vacancies first, they and their pointers must fit in the particle arrays
+    int num_leaving_received = 0;
+    for(n=0; n<num_neighbors; n++)
+        num_leaving_received += edges->recv_header[2*n];
+    int num_past_max = num_leaving_received - out_of_bounds->number_vacancies;
+    if(num_past_max > 0)
+        check_particle_room(num_past_max, params->max_fluid_particles_local - (params->max_fluid_particle_index + 1));
+    check_particle_room(num_leaving_received, params->max_fluid_particles_local - params->number_fluid_particles_local);
+
+    // Place received particles into vacancies, starting at end, or past the maximum index
+    int num_particles = params->number_fluid_particles_local;
+    for(n=0; n<num_neighbors; n++) {
+        start = edges->recv_displs[n];
+        end = start + edges->recv_header[2*n];
+        for(i=start; i<end; i++) {
+            if(out_of_bounds->number_vacancies > 0)
+                index = out_of_bounds->vacant_indicies[--out_of_bounds->number_vacancies];
+            else
+                index = ++params->max_fluid_particle_index;
+            fluid_particles[index] = edges->recv_particles[i];
+            fluid_particle_pointers[num_particles] = &fluid_particles[index];
             fluid_particle_pointers[num_particles]->id = num_particles;
             num_particles++;
         }
     }
-
     params->number_fluid_particles_local = num_particles;
 
-    // Need to add rank to debug_print
-    debug_print("num local: %d\n", num_particles);
+    debug_print("exchange: recv %d leaving, num vacant %d\n", num_leaving_received, out_of_bounds->number_vacancies);
+
+    // Copy halo particles after the, possibly increased, maximum index
+    fluid_particle *halo = &fluid_particles[params->max_fluid_particle_index + 1];
+    int max_halo = params->max_fluid_particles_local - (params->max_fluid_particle_index + 1);
+    int num_receiving = 0;
+    for(n=0; n<num_neighbors; n++)
+        num_receiving += edges->recv_counts[n];
+    check_particle_room(num_receiving - num_leaving_received + edges->number_shared_halo_particles, max_halo);
+    int num_halo = 0;
+    for(n=0; n<num_neighbors; n++) {
+        start = edges->recv_displs[n] + edges->recv_header[2*n];
+        end = edges->recv_displs[n] + edges->recv_counts[n];
+        for(i=start; i<end; i++)
+            halo[num_halo++] = edges->recv_particles[i];
+    }
+    // Same host halo particles were copied in after everything received, a rank may have no neighbors
+    for(i=0; i<edges->number_shared_halo_particles; i++)
+        halo[num_halo++] = edges->recv_particles[num_receiving + i];
+
+    // Particles that have just left are still near enough to interact with
+    for(n=0; n<num_neighbors; n++) {
+        start = edges->send_displs[n];
+        end = start + edges->send_header[2*n];
+        for(i=start; i<end; i++) {
+            if(in_halo(&edges->send_particles[i], graph, rank, h)) {
+                check_particle_room(num_halo + 1, max_halo);
+                halo[num_halo++] = edges->send_particles[i];
+            }
+        }
+    }
 
-    // Free indexed types
-    MPI_Type_free(&LeftRecvtype);
-    MPI_Type_free(&RightRecvtype);
-    MPI_Type_free(&LeftMovetype);
-    MPI_Type_free(&RightMovetype);
+    set_halo_pointers(fluid_particle_pointers, fluid_particles, num_halo, params);
 
-    free(blocklens_left);
-    free(blocklens_right);
-    free(indicies_left);
-    free(indicies_right);
-    free(blocklens_recv);
-    free(indicies_recv);
+    debug_print("num local: %d, num halo %d\n", num_particles, num_halo);
+}
+
+// Byte offsets into a frame window buffer
+// Each buffer starts with the number of compute ranks that have put the frame it holds
+static MPI_Aint frame_ready_disp(frame_window_t *frame_window, int buffer)
+{
+    return buffer * frame_window->buffer_size;
 }
 
+// Followed by the number of frames the render rank has released from it
+static MPI_Aint frame_released_disp(frame_window_t *frame_window, int buffer)
+{
+    return frame_ready_disp(frame_window, buffer) + sizeof(int);
+}
+
+// Each compute rank puts its number of particles, the number of coordinates sent, the number of packed bytes, and the number of density tile bytes
+// Packed and tile bytes are 0 if the slot holds raw coordinates
+#define FRAME_NUM_COUNTS 4
+static MPI_Aint frame_count_disp(frame_window_t *frame_window, int buffer, int rank)
+{
+    return frame_ready_disp(frame_window, buffer) + (2 + FRAME_NUM_COUNTS*rank) * sizeof(int);
+}
+
+// Start and end x of each compute ranks partition, shown as dividers
+static MPI_Aint frame_partition_disp(frame_window_t *frame_window, int buffer, int rank)
+{
+    return frame_count_disp(frame_window, buffer, frame_window->num_compute_procs) + 2*rank*sizeof(float);
+}
+
+static MPI_Aint frame_coords_disp(frame_window_t *frame_window, int buffer, int rank)
+{
+    return frame_partition_disp(frame_window, buffer, frame_window->num_compute_procs) + (MPI_Aint)rank * frame_window->slot_size;
+}
+
+// Set slot and buffer sizes of the window
+static void size_frame_window(frame_window_t *frame_window, int num_compute_procs, int max_particles, float *field_dims)
+{
+    frame_window->num_compute_procs = num_compute_procs;
+    frame_window->max_particles = max_particles;
+    frame_window->slot_size = 2 * max_particles * sizeof(short);
+    #ifdef DENSITY_FRAMES
+    // A slot must also hold a density tile covering the entire field
+    MPI_Aint field_bytes = FRAME_FIELD_BYTES(field_dims[0], field_dims[1]);
+    if(field_bytes > frame_window->slot_size)
+        frame_window->slot_size = field_bytes;
+    #else
+    (void)field_dims;
+    #endif
+    // Keep slots int aligned for tile headers
+    frame_window->slot_size = (frame_window->slot_size + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+    frame_window->buffer_size = 0;
+    frame_window->buffer_size = frame_coords_disp(frame_window, 0, num_compute_procs);
+}
+
+// Bytes of window memory on each render rank
+// Coordinate slots are aligned to whole (x,y) pairs so the memory can be used as a vertex buffer
+MPI_Aint frame_window_bytes(int num_compute_procs, int max_particles, float *field_dims)
+{
+    frame_window_t frame_window;
+    size_frame_window(&frame_window, num_compute_procs, max_particles, field_dims);
+    return 2 * frame_window.buffer_size;
+}
+
+// Create the window particle coordinates are delivered through
+// The frame format used is the lowest supported by any rank
+// field_dims is set on render rank 0 and received by all other ranks, tiles must match its resolution
+// With ZERO_COPY_FRAMES a render rank may pass frame_window_bytes of memory to receive frames into, such as a mapped vertex buffer,
+// otherwise memory is NULL
+// Collective over MPI_COMM_SIM, window memory is only allocated on render ranks
+void create_frame_window(frame_window_t *frame_window, int num_compute_procs, int max_particles, float *field_dims, char *memory)
+{
+    int i, rank;
+    MPI_Comm_rank(MPI_COMM_SIM, &rank);
+    bool render = rank < NUM_RENDER_PROCS;
+
+    MPI_Bcast(field_dims, 3, MPI_FLOAT, 0, MPI_COMM_SIM);
+    memcpy(frame_window->field_dims, field_dims, sizeof(frame_window->field_dims));
+
+    frame_window->rank = rank;
+    frame_window->frame = 0;
+    frame_window->released = 0;
+    frame_window->deliver = true;
+    frame_window->partition[0] = 0.0f;
+    frame_window->partition[1] = 0.0f;
+    size_frame_window(frame_window, num_compute_procs, max_particles, field_dims);
+
+    // The render node only asks for packed frames when built with COMPRESS_FRAMES
+    int format = FRAME_FORMAT_LATEST;
+    #ifndef COMPRESS_FRAMES
+    if(render)
+        format = FRAME_FORMAT_RAW;
+    #endif
+    MPI_Allreduce(&format, &frame_window->format, 1, MPI_INT, MPI_MIN, MPI_COMM_SIM);
+
+    frame_window->packed = NULL;
+    frame_window->scratch = NULL;
+    frame_window->rank_coords = NULL;
+    if(frame_window->format == FRAME_FORMAT_PACKED) {
+        if(render) {
+            frame_window->scratch = malloc((size_t)num_compute_procs * 2 * max_particles * sizeof(short));
+            frame_window->rank_coords = malloc(num_compute_procs * sizeof(short*));
+        }
+        else {
+            frame_window->packed = malloc(2 * max_particles * sizeof(short));
+            frame_window->scratch = malloc(FRAME_PACK_SCRATCH(2 * max_particles));
+        }
+    }
+    else if(render)
+        frame_window->rank_coords = malloc(num_compute_procs * sizeof(short*));
+
+    frame_window->field = NULL;
+    frame_window->field_scratch = NULL;
+    #ifdef DENSITY_FRAMES
+    MPI_Aint field_bytes = FRAME_FIELD_BYTES(field_dims[0], field_dims[1]);
+    size_t num_texels = (size_t)field_dims[0] * (size_t)field_dims[1];
+    if(render)
+        frame_window->field = malloc(4 * num_texels);
+    else {
+        frame_window->field = malloc(field_bytes);
+        frame_window->field_scratch = malloc(num_texels * sizeof(float));
+    }
+    #endif
+
+    MPI_Aint window_size = render ? 2 * frame_window->buffer_size : 0;
+    frame_window->allocated = NULL;
+    #ifdef ZERO_COPY_FRAMES
+    // Every rank must create the window the same way, render ranks without memory given allocate their own
+    if(render && !memory)
+        memory = frame_window->allocated = malloc(window_size);
+    frame_window->base = memory;
+    MPI_Win_create(memory, window_size, 1, MPI_INFO_NULL, MPI_COMM_SIM, &frame_window->win);
+    #else
+    (void)memory;
+    MPI_Win_allocate(window_size, 1, MPI_INFO_NULL, MPI_COMM_SIM, &frame_window->base, &frame_window->win);
+    #endif
+
+    // All ranks remain in a passive target epoch until the window is freed
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, frame_window->win);
+
+    // Ready and released counts, counts, and partitions start at zero
+    if(render) {
+        for(i=0; i<2; i++)
+            memset(frame_window->base + frame_ready_disp(frame_window, i), 0, frame_coords_disp(frame_window, 0, 0));
+        MPI_Win_sync(frame_window->win);
+    }
+    MPI_Barrier(MPI_COMM_SIM);
+}
+
+void free_frame_window(frame_window_t *frame_window)
+{
+    MPI_Win_unlock_all(frame_window->win);
+    MPI_Win_free(&frame_window->win);
+
+    free(frame_window->allocated);
+    free(frame_window->packed);
+    free(frame_window->scratch);
+    free(frame_window->rank_coords);
+    free(frame_window->field);
+    free(frame_window->field_scratch);
+}
+
+// Return true if every render rank has released the frame last put into the current buffer
+// Frames alternate between two buffers, so each has been released frame/2 times before the current frame is put
+// The counts are only read, a compute rank never waits for the renderer
+static bool frame_buffer_released(frame_window_t *frame_window)
+{
+    int tile;
+    int buffer = frame_window->frame % 2;
+    int released = 0;
+
+    for(tile=0; tile<NUM_RENDER_PROCS; tile++) {
+        MPI_Fetch_and_op(NULL, &released, MPI_INT, tile, frame_released_disp(frame_window, buffer), MPI_NO_OP, frame_window->win);
+        MPI_Win_flush(tile, frame_window->win);
+        if(released < frame_window->frame / 2)
+            return false;
+    }
+    return true;
+}
+
+// Put a slot and its counts into the current frame buffer on the render rank showing tile
+static void put_frame_slot(frame_window_t *frame_window, int tile, void *slot, int bytes, int *counts)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+
+    int buffer = frame_window->frame % 2;
+    int one = 1;
+
+    MPI_Put(slot, bytes, MPI_BYTE, tile, frame_coords_disp(frame_window, buffer, rank), bytes, MPI_BYTE, frame_window->win);
+    MPI_Put(counts, FRAME_NUM_COUNTS, MPI_INT, tile, frame_count_disp(frame_window, buffer, rank), FRAME_NUM_COUNTS, MPI_INT, frame_window->win);
+    MPI_Put(frame_window->partition, 2, MPI_FLOAT, tile, frame_partition_disp(frame_window, buffer, rank), 2, MPI_FLOAT, frame_window->win);
+
+    // Slot must be complete on the render rank before it's counted as ready
+    MPI_Win_flush(tile, frame_window->win);
+    MPI_Accumulate(&one, 1, MPI_INT, tile, frame_ready_disp(frame_window, buffer), 1, MPI_INT, MPI_SUM, frame_window->win);
+    MPI_Win_flush(tile, frame_window->win);
+}
+
+// Put this compute ranks coordinates within tile into the current frame buffer on the render rank showing it
+// num_particles is the number of local particles, including those not sent
+void put_frame(frame_window_t *frame_window, int tile, short *coords, int num_coords, int num_particles)
+{
+    int counts[FRAME_NUM_COUNTS];
+    counts[0] = num_particles;
+    counts[1] = num_coords;
+    counts[2] = 0;
+    counts[3] = 0;
+
+    // Fall back to raw coordinates for a frame that doesn't pack smaller
+    if(frame_window->format == FRAME_FORMAT_PACKED)
+        counts[2] = pack_frame(coords, num_coords, frame_window->packed, (unsigned short*)frame_window->scratch);
+
+    if(counts[2])
+        put_frame_slot(frame_window, tile, frame_window->packed, counts[2], counts);
+    else
+        put_frame_slot(frame_window, tile, coords, num_coords * sizeof(short), counts);
+}
+
+// Put the density tile of this compute ranks coordinates within tile into the current frame buffer on the render rank showing it
+// Only available when built with DENSITY_FRAMES
+void put_frame_field(frame_window_t *frame_window, int tile, short *coords, int num_coords, int num_particles)
+{
+    int counts[FRAME_NUM_COUNTS];
+    counts[0] = num_particles;
+    counts[1] = num_coords;
+    counts[2] = 0;
+    counts[3] = splat_frame_field(coords, num_coords, frame_window->field_dims, frame_window->field_scratch, frame_window->field);
+
+    put_frame_slot(frame_window, tile, frame_window->field, counts[3], counts);
+}
+
+// Put empty slots into every tile for idle compute ranks so render ranks still wait on all compute ranks
+// Only the lead puts them
+void put_idle_frames(frame_window_t *frame_window, comm_graph_t *graph)
+{
+    int i, tile, rank;
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+
+    int num_idle = graph->nprocs - graph->num_members;
+    if(rank != LEAD_RANK || !num_idle)
+        return;
+
+    int buffer = frame_window->frame % 2;
+    int counts[FRAME_NUM_COUNTS] = {0};
+    int header[FRAME_FIELD_HEADER] = {0};
+
+    // An empty density tile header is put as well in case the frame is sent as density tiles
+    for(tile=0; tile<NUM_RENDER_PROCS; tile++) {
+        for(i=0; i<graph->nprocs; i++) {
+            if(graph->active_ranks[i] >= 0)
+                continue;
+            MPI_Put(header, FRAME_FIELD_HEADER, MPI_INT, tile, frame_coords_disp(frame_window, buffer, i), FRAME_FIELD_HEADER, MPI_INT, frame_window->win);
+            MPI_Put(counts, FRAME_NUM_COUNTS, MPI_INT, tile, frame_count_disp(frame_window, buffer, i), FRAME_NUM_COUNTS, MPI_INT, frame_window->win);
+        }
+        MPI_Win_flush(tile, frame_window->win);
+        MPI_Accumulate(&num_idle, 1, MPI_INT, tile, frame_ready_disp(frame_window, buffer), 1, MPI_INT, MPI_SUM, frame_window->win);
+        MPI_Win_flush(tile, frame_window->win);
+    }
+}
+
+// Every tile of the current frame has been put, the next frame goes into the other buffer
+void end_frame(frame_window_t *frame_window)
+{
+    frame_window->frame++;
+}
+
+// Wait on a render rank until all compute ranks have put the current frame
+// Coordinate and particle counts of each compute rank are copied into coord_counts and particle_counts,
+// the start_x,end_x pair of each compute ranks partition into partition_edges
+// Returns the coordinates of each compute rank, or NULL if the frame was sent as density tiles, the assembled field is then in frame_window->field
+short **wait_frame(frame_window_t *frame_window, int *coord_counts, int *particle_counts, float *partition_edges)
+{
+    int i;
+    int buffer = frame_window->frame % 2;
+    int ready = 0;
+
+    #ifdef RENDER_HOST_COMPUTE
+    struct timespec interval = {0, RENDER_POLL_US * 1000};
+    #endif
+
+    while(1) {
+        MPI_Fetch_and_op(NULL, &ready, MPI_INT, frame_window->rank, frame_ready_disp(frame_window, buffer), MPI_NO_OP, frame_window->win);
+        MPI_Win_flush(frame_window->rank, frame_window->win);
+        if(ready >= frame_window->num_compute_procs)
+            break;
+        #ifdef RENDER_HOST_COMPUTE
+        nanosleep(&interval, NULL);
+        #endif
+    }
+
+    // Make put values visible to local loads
+    MPI_Win_sync(frame_window->win);
+
+    int *counts = (int*)(frame_window->base + frame_count_disp(frame_window, buffer, 0));
+    float *partitions = (float*)(frame_window->base + frame_partition_disp(frame_window, buffer, 0));
+    bool field_frame = false;
+    short *unpacked;
+    for(i=0; i<frame_window->num_compute_procs; i++) {
+        particle_counts[i] = counts[FRAME_NUM_COUNTS*i];
+        coord_counts[i] = counts[FRAME_NUM_COUNTS*i+1];
+        partition_edges[2*i] = partitions[2*i];
+        partition_edges[2*i+1] = partitions[2*i+1];
+        frame_window->rank_coords[i] = (short*)(frame_window->base + frame_coords_disp(frame_window, buffer, i));
+
+        // Packed coordinates are unpacked into the same slot of the scratch buffer
+        if(counts[FRAME_NUM_COUNTS*i+2]) {
+            unpacked = (short*)frame_window->scratch + (size_t)i * 2 * frame_window->max_particles;
+            unpack_frame((unsigned char*)frame_window->rank_coords[i], coord_counts[i], unpacked);
+            frame_window->rank_coords[i] = unpacked;
+        }
+
+        if(counts[FRAME_NUM_COUNTS*i+3])
+            field_frame = true;
+    }
+
+    // Density tiles of all compute ranks are summed into a single field
+    if(field_frame) {
+        memset(frame_window->field, 0, 4 * (size_t)frame_window->field_dims[0] * (size_t)frame_window->field_dims[1]);
+        for(i=0; i<frame_window->num_compute_procs; i++)
+            add_frame_field((unsigned char*)frame_window->rank_coords[i], frame_window->field_dims, frame_window->field);
+        frame_window->frame++;
+        return NULL;
+    }
+
+    frame_window->frame++;
+    return frame_window->rank_coords;
+}
+
+// Done reading the oldest frame not yet released, compute ranks may put into its buffer again
+// Frames may be released after the next has been waited on
+void release_frame(frame_window_t *frame_window)
+{
+    int buffer = frame_window->released % 2;
+    int not_ready = -frame_window->num_compute_procs;
+    int one = 1;
+    int previous;
+
+    // Compute ranks don't put into the buffer until it's released, the ready count must be reset first
+    MPI_Fetch_and_op(&not_ready, &previous, MPI_INT, frame_window->rank, frame_ready_disp(frame_window, buffer), MPI_SUM, frame_window->win);
+    MPI_Win_flush(frame_window->rank, frame_window->win);
+    MPI_Fetch_and_op(&one, &previous, MPI_INT, frame_window->rank, frame_released_disp(frame_window, buffer), MPI_SUM, frame_window->win);
+    MPI_Win_flush(frame_window->rank, frame_window->win);
+
+    frame_window->released++;
+}
+
+// Create the window the number of published parameter versions is read from, collective over MPI_COMM_SIM
+static void create_param_window(param_channel_t *channel)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_SIM, &rank);
+
+    MPI_Aint size = rank == 0 ? sizeof(int) : 0;
+    MPI_Win_allocate(size, sizeof(int), MPI_INFO_NULL, MPI_COMM_SIM, &channel->published_version, &channel->win);
+    if(rank == 0)
+        *channel->published_version = 0;
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, channel->win);
+    MPI_Barrier(MPI_COMM_SIM);
+}
+
+// Render node side of the parameter channel, collective with init_param_receiver over MPI_COMM_SIM
+void init_param_channel(param_channel_t *channel, int num_compute_procs, tunable_parameters *node_params)
+{
+    int i;
+
+    create_param_window(channel);
+
+    channel->num_compute_procs = num_compute_procs;
+    channel->version = 0;
+    channel->published = malloc(num_compute_procs * sizeof(tunable_parameters));
+    channel->reqs = malloc(num_compute_procs * sizeof(MPI_Request));
+    for(i=0; i<num_compute_procs; i++) {
+        channel->published[i] = node_params[i];
+        channel->reqs[i] = MPI_REQUEST_NULL;
+    }
+}
+
+// Compare field by field, padding between fields is undefined
+static bool params_equal(tunable_parameters *a, tunable_parameters *b)
+{
+    return a->rest_density == b->rest_density &&
+           a->smoothing_radius == b->smoothing_radius &&
+           a->g == b->g &&
+           a->k == b->k &&
+           a->k_near == b->k_near &&
+           a->k_spring == b->k_spring &&
+           a->sigma == b->sigma &&
+           a->beta == b->beta &&
+           a->time_step == b->time_step &&
+           a->halo_refresh_fraction == b->halo_refresh_fraction &&
+           a->node_start_x == b->node_start_x &&
+           a->node_end_x == b->node_end_x &&
+           a->mover_center_x == b->mover_center_x &&
+           a->mover_center_y == b->mover_center_y &&
+           a->mover_width == b->mover_width &&
+           a->mover_height == b->mover_height &&
+           a->view_min_x == b->view_min_x &&
+           a->view_min_y == b->view_min_y &&
+           a->view_max_x == b->view_max_x &&
+           a->view_max_y == b->view_max_y &&
+           a->mover_type == b->mover_type &&
+           a->kill_sim == b->kill_sim &&
+           a->active == b->active &&
+           a->density_field == b->density_field;
+}
+
+// Send parameters to all compute ranks if any have changed since last published
+// Every version is sent to every compute rank so the number received identifies the version
+// The version is published once it has been sent so a compute rank reading it may receive it
+void publish_params(param_channel_t *channel, tunable_parameters *node_params)
+{
+    int i;
+    int num_compute_procs = channel->num_compute_procs;
+
+    bool changed = false;
+    for(i=0; i<num_compute_procs && !changed; i++)
+        changed = !params_equal(&channel->published[i], &node_params[i]);
+    if(!changed)
+        return;
+
+    // The previous version has long since been sent
+    MPI_Waitall(num_compute_procs, channel->reqs, MPI_STATUSES_IGNORE);
+
+    channel->version++;
+    for(i=0; i<num_compute_procs; i++) {
+        channel->published[i] = node_params[i];
+        MPI_Isend(&channel->published[i], 1, TunableParamtype, i+NUM_RENDER_PROCS, PARAM_TAG, MPI_COMM_SIM, &channel->reqs[i]);
+    }
+
+    int one = 1;
+    int previous;
+    MPI_Fetch_and_op(&one, &previous, MPI_INT, 0, 0, MPI_SUM, channel->win);
+    MPI_Win_flush(0, channel->win);
+}
+
+// Compute rank side of the parameter channel, collective with init_param_channel over MPI_COMM_SIM
+void init_param_receiver(param_channel_t *channel)
+{
+    create_param_window(channel);
+
+    channel->num_compute_procs = 0;
+    channel->version = 0;
+    channel->published = NULL;
+    channel->reqs = NULL;
+}
+
+// Read the number of parameter versions published by the render node without involving it
+static int read_param_version(param_channel_t *channel)
+{
+    int version;
+    MPI_Fetch_and_op(NULL, &version, MPI_INT, 0, 0, MPI_NO_OP, channel->win);
+    MPI_Win_flush(0, channel->win);
+    return version;
+}
+
+// Match all outstanding parameters before shutdown, collective over MPI_COMM_SIM
+// Ranks that were idle when the simulation ended may not have received the last parameters
+void close_param_channel(param_channel_t *channel)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_SIM, &rank);
+
+    int sent = channel->version;
+    MPI_Bcast(&sent, 1, MPI_INT, 0, MPI_COMM_SIM);
+
+    if(rank == 0) {
+        MPI_Waitall(channel->num_compute_procs, channel->reqs, MPI_STATUSES_IGNORE);
+        free(channel->published);
+        free(channel->reqs);
+    }
+    else if(rank >= NUM_RENDER_PROCS) {
+        tunable_parameters params;
+        catch_up_params(channel, &params, sent);
+    }
+
+    MPI_Win_unlock_all(channel->win);
+    MPI_Win_free(&channel->win);
+}
@@ -27,37 +27,193 @@ THE SOFTWARE.
 
 typedef struct EDGE_T edge_t;
 typedef struct OOB_T oob_t;
+typedef struct COMM_GRAPH_T comm_graph_t;
+typedef struct PROGRESS_T progress_t;
+typedef struct FRAME_WINDOW_T frame_window_t;
+typedef struct PARAM_CHANNEL_T param_channel_t;
 
 #include "fluid.h"
 #include "mpi.h"
 
+// The view is split into RENDER_TILES_X by RENDER_TILES_Y tiles, each shown by its own render rank
+// Render ranks are the first NUM_RENDER_PROCS ranks, tile 0 is bottom left and also handles input
+#ifndef RENDER_TILES_X
+#define RENDER_TILES_X 1
+#endif
+#ifndef RENDER_TILES_Y
+#define RENDER_TILES_Y 1
+#endif
+#define NUM_RENDER_PROCS (RENDER_TILES_X * RENDER_TILES_Y)
+
+// Tags of messages from the render node to compute ranks
+#define PARAM_TAG 20
+
+// Tags of membership messages between compute ranks
+#define JOIN_TAG 22
+#define WAKE_TAG 23
+#define ACTIVE_COMM_TAG 24
+
+// Tags of particle exchange messages between neighbors
+#define EXCHANGE_HEADER_TAG 25
+#define EXCHANGE_PARTICLE_TAG 26
+
+// The lowest compute rank leads membership changes, the render node never removes its partition
+#define LEAD_RANK 0
+
+// Microseconds an idle compute rank sleeps between polls
+#define IDLE_INTERVAL_US 1000
+
+// The last SPARE_COMPUTE_PROCS compute ranks start idle, the render node adds them to the simulation as needed
+#ifndef SPARE_COMPUTE_PROCS
+#define SPARE_COMPUTE_PROCS 0
+#endif
+#define INITIAL_ACTIVE_PROCS(nprocs) ((nprocs) > SPARE_COMPUTE_PROCS ? (nprocs) - SPARE_COMPUTE_PROCS : 1)
+
+// The world is split into STRIPS_PER_RANK strips along x for each compute rank, partitions are made of whole strips
+#ifndef STRIPS_PER_RANK
+#define STRIPS_PER_RANK 4
+#endif
+
+#ifdef RENDER_HOST_COMPUTE
+// Compute ranks on a render ranks host are balanced with this fraction of their measured speed, leaving the host headroom to render
+#ifndef RENDER_HOST_SHARE
+#define RENDER_HOST_SHARE 0.5f
+#endif
+
+// Microseconds a render rank sleeps between polls for a frame, its core is free for compute ranks on the host meanwhile
+#define RENDER_POLL_US 200
+#endif
+
+#ifdef PROGRESS_THREAD
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Microseconds the progress thread sleeps between polls
+#define PROGRESS_INTERVAL_US 50
+#endif
+
 // MPI globals
 MPI_Datatype Particletype;
 MPI_Datatype TunableParamtype;
-MPI_Datatype LeftEdgetype;
-MPI_Datatype RightEdgetype;
+MPI_Comm MPI_COMM_SIM;     // All ranks ordered by host, used in place of MPI_COMM_WORLD
 MPI_Comm MPI_COMM_COMPUTE;
+MPI_Comm MPI_COMM_RENDER;
 MPI_Group group_world;
 MPI_Group group_compute;
 MPI_Group group_render;
 
-// Particles that are within 2*h distance of node edge
+// Distributed graph of compute ranks whose strips, or particles, are within h of this ranks strips or particles
+// A partition is any set of strips, neighbors need not be adjacent and a strip narrower than h has neighbors further away
+// Only members of active_comm take part, a rank that is inactive and holds no particles leaves it and idles
+struct COMM_GRAPH_T {
+    MPI_Comm comm;        // Graph communicator used for neighborhood collectives
+    MPI_Comm active_comm; // Compute ranks taking part in the simulation, MPI_COMM_NULL while idle
+    int rank;             // MPI_COMM_COMPUTE rank of this rank
+    int nprocs;           // Number of compute ranks
+    bool render_host;     // This rank shares its host with a render rank
+    int num_members;      // Number of ranks in active_comm
+    int *members;         // MPI_COMM_COMPUTE rank of each active_comm rank
+    int *active_ranks;    // active_comm rank of each compute rank, -1 if idle
+    int num_neighbors;
+    int *neighbor_ranks;  // MPI_COMM_COMPUTE rank of each neighbor in graph order
+    int *graph_ranks;     // active_comm rank of each neighbor in graph order
+    int num_strips;       // STRIPS_PER_RANK strips for each compute rank
+    float strip_min_x;    // Start of the first strip
+    float strip_width;
+    int *strip_owners;    // MPI_COMM_COMPUTE rank owning each strip, the same on every member
+    char *occupied;       // Strips each member holds particles in, gathered to find neighbors
+    char *reach;          // Strips within h of this ranks strips or particles
+    int *joining;         // Lead: compute ranks that have asked to rejoin
+    int *scratch;         // Gathered membership and wake messages
+    bool join_requested;  // Idle rank: asked the lead to rejoin and not yet woken
+    #ifdef SHM_HALO
+    MPI_Comm node_comm;   // Compute ranks sharing memory with this rank
+    MPI_Comm active_node_comm; // Members of node_comm that are also in active_comm
+    int *node_ranks;      // node_comm rank of each neighbor, MPI_UNDEFINED if on another host
+    #endif
+};
+
+// Particles that are within h distance of a neighbors partition
 struct EDGE_T {
     int max_edge_particles;
-    fluid_particle **edge_pointers_left;
-    fluid_particle **edge_pointers_right;
-    int number_edge_particles_left;
-    int number_edge_particles_right;
-    MPI_Request reqs[4];
+    fluid_particle *send_particles; // Packed halo particles grouped by neighbor
+    int *send_counts;
+    int *send_displs;
+    int *recv_counts;
+    int *recv_displs;
+    int *send_header;               // Number of leaving and halo particles sent to each neighbor
+    int *recv_header;               // Number of leaving and halo particles received from each neighbor
+    fluid_particle *recv_particles; // Received leaving and halo particles, sized as the particle array
+    int number_edge_particles;
+    int *edge_indicies;             // Pointer array index of each particle sent as a halo particle
+    float *edge_positions;          // x,y position of each edge particle when it was sent
+    int *halo_counts;               // Halo particles received from each neighbor in the last halo exchange
+    bool *refresh_wanted;           // This rank needs the particle exchange with each neighbor
+    bool *refresh;                  // Either side of each neighbor pair needs the particle exchange
+    bool refresh_shared;            // A rank on this host needs same host halo particles recopied
+    MPI_Request req;
+    MPI_Request *reqs;              // Particle exchange messages, two for each neighbor
+    int num_reqs;
+    #ifdef SHM_HALO
+    MPI_Win win;                     // Shared window holding each ranks particles and published edge indicies
+    fluid_particle **node_particles; // Particle array of each node_comm rank
+    int **node_edge_indicies;        // Edge indicies published by each node_comm rank, first entry is the count
+    #endif
+    int number_shared_halo_particles; // Halo particles copied from same host neighbors
+};
+
+#ifdef PROGRESS_THREAD
+// Thread driving nonblocking transfers while the main thread computes
+struct PROGRESS_T {
+    pthread_t thread;
+    MPI_Comm comm;       // Private communicator polled by the thread
+    atomic_bool running;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool polling;        // A transfer is outstanding, the thread waits on wake otherwise
+};
+#endif
+
+// Window on the render node that compute ranks put particle coordinates into
+// Two buffers alternate between frames, each holds a ready count, the number of coordinates and packed bytes
+// put by each compute rank, its partition, and a slot of 2*max_particles coordinates for each compute rank
+struct FRAME_WINDOW_T {
+    MPI_Win win;
+    int rank;              // Rank in MPI_COMM_SIM, render ranks poll their own window memory
+    int num_compute_procs;
+    int max_particles;
+    MPI_Aint slot_size;    // Bytes each compute rank may put into a buffer
+    MPI_Aint buffer_size;  // Bytes in each buffer
+    char *base;            // Window memory, only allocated on render ranks
+    char *allocated;       // Window memory to free, if allocated here rather than by MPI or given
+    int frame;             // Number of frames delivered, selects the buffer
+    int released;          // Render rank: number of frames released, the oldest frame not yet released is released next
+    bool deliver;          // Compute rank: the current frame is put, otherwise the renderer still holds its buffer and it's dropped
+    float partition[2];    // Compute rank: start and end x of its partition, put with every slot for the dividers
+    int format;            // Negotiated FRAME_FORMAT
+    unsigned char *packed; // Compute rank: packed coordinates
+    void *scratch;         // Compute rank: space to pack coordinates, render node: unpacked coordinates
+    short **rank_coords;   // Render node: coordinates of each compute rank for the current frame
+    float field_dims[3];   // Liquid density field width, height, and particle diameter in texels
+    unsigned char *field;  // Render node: assembled RGBA density field, compute rank: density tile
+    float *field_scratch;  // Compute rank: density accumulated while splatting a tile
+};
+
+// Parameters sent from the render node only when changed
+// The number of versions published is kept in a window on the input rank that compute ranks poll with a one-sided get
+struct PARAM_CHANNEL_T {
+    MPI_Win win;
+    int *published_version;        // Input rank: window memory holding the number of versions published
+    int num_compute_procs;
+    int version;                   // Number of parameter versions published or received
+    tunable_parameters *published; // Render node: last published parameters of each compute rank
+    MPI_Request *reqs;             // Render node: parameter sends
 };
 
 // Particles that have left the node
 struct OOB_T {
-    int max_oob_particles;
-    int *oob_pointer_indicies_left; // Indicies in particle pointer array for particles traveling left
-    int *oob_pointer_indicies_right;
-    int number_oob_particles_left;
-    int number_oob_particles_right;
+    int *destinations;    // Graph neighbor index each local particle is leaving to, -1 if staying
+    int number_oob_particles;
     int *vacant_indicies; // Indicies in particle array that are vacant
     int number_vacancies;
 };
@@ -65,8 +221,41 @@ struct OOB_T {
 void createMpiTypes();
 void create_communicators();
 void freeMpiTypes();
-void startHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, param *params);
-void finishHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, param *params);
-void transferOOBParticles(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, param *params);
+#ifdef PROGRESS_THREAD
+void start_progress_thread(progress_t *progress);
+void stop_progress_thread(progress_t *progress);
+void resume_progress_thread(progress_t *progress);
+void pause_progress_thread(progress_t *progress);
+#endif
+void init_comm_graph(comm_graph_t *graph);
+bool update_active_ranks(comm_graph_t *graph, param_channel_t *channel, param *params, frame_window_t *frame_window);
+bool wait_while_idle(comm_graph_t *graph, param_channel_t *channel, tunable_parameters *params, frame_window_t *frame_window);
+void release_idle_ranks(comm_graph_t *graph);
+void init_strips(comm_graph_t *graph, AABB_t *boundary_global, param *params);
+int strip_index(comm_graph_t *graph, float x);
+void update_comm_graph(fluid_particle **fluid_particle_pointers, comm_graph_t *graph, param *params);
+void free_comm_graph(comm_graph_t *graph);
+#ifdef SHM_HALO
+fluid_particle *create_shared_particles(edge_t *edges, comm_graph_t *graph, int max_fluid_particles_local);
+void free_shared_particles(edge_t *edges);
+#endif
+void startHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, comm_graph_t *graph, param *params);
+void finishHaloExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,  edge_t *edges, comm_graph_t *graph, param *params);
+MPI_Aint frame_window_bytes(int num_compute_procs, int max_particles, float *field_dims);
+void create_frame_window(frame_window_t *frame_window, int num_compute_procs, int max_particles, float *field_dims, char *memory);
+void free_frame_window(frame_window_t *frame_window);
+void put_frame(frame_window_t *frame_window, int tile, short *coords, int num_coords, int num_particles);
+void put_frame_field(frame_window_t *frame_window, int tile, short *coords, int num_coords, int num_particles);
+void put_idle_frames(frame_window_t *frame_window, comm_graph_t *graph);
+void end_frame(frame_window_t *frame_window);
+short **wait_frame(frame_window_t *frame_window, int *coord_counts, int *particle_counts, float *partition_edges);
+void release_frame(frame_window_t *frame_window);
+void init_param_channel(param_channel_t *channel, int num_compute_procs, tunable_parameters *node_params);
+void publish_params(param_channel_t *channel, tunable_parameters *node_params);
+void init_param_receiver(param_channel_t *channel);
+void close_param_channel(param_channel_t *channel);
+bool halo_refresh_needed(fluid_particle **fluid_particle_pointers, edge_t *edges, comm_graph_t *graph, param *params);
+void startParticleExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, edge_t *edges, comm_graph_t *graph, param *params);
+void finishParticleExchange(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, edge_t *edges, comm_graph_t *graph, param *params);
 
 #endif
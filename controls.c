@@ -400,8 +400,8 @@ void set_fluid_b(render_t *render_state)
     }
 }
 
-// Set last partition to be outside of simulation bounds
-// Effectively removing it from the simulation
+// Remove the last active rank from the simulation
+// Compute ranks move its partition outside of the world and rebalance, the rank idles once its particles have moved
 void remove_partition(render_t *render_state)
 {
     if(render_state->num_compute_procs_active == 1) 
@@ -411,43 +411,25 @@ void remove_partition(render_t *render_state)
 
     int removed_rank = num_compute_procs_active-1;
 
-    // Set new end position of last active proc to end of simulation
-    render_state->master_params[removed_rank-1].node_end_x = render_state->master_params[removed_rank].node_end_x;
-
-    // Send start and end x out of sim bounds
-    float position = render_state->master_params[removed_rank].node_end_x + 1.0; // +1.0 ensures it's out of the simulation bounds
-    render_state->master_params[removed_rank].node_start_x = position;
-    render_state->master_params[removed_rank].node_end_x = position;
-
     // Set active to false for removed rank
     render_state->master_params[removed_rank].active = false;
 
     render_state->num_compute_procs_active -= 1;
 }
 
-// Add on partition to right side that has been removed
+// Add on partition to right side that has been removed, or a spare rank
 void add_partition(render_t *render_state)
 {
     if(render_state->num_compute_procs_active == render_state->num_compute_procs)
 	return;
 
-    // Length of currently last partiion
     int num_compute_procs_active = render_state->num_compute_procs_active;
-    float length = render_state->master_params[num_compute_procs_active-1].node_end_x - render_state->master_params[num_compute_procs_active-1].node_start_x;
     float h = render_state->master_params[0].smoothing_radius;
 
-    // If the last partition is too small we can't split it and another
-    if(length < 2.5*h)
+    // If partitions would become too small we can't add another
+    if(render_state->sim_width/(num_compute_procs_active+1) < 1.25*h)
 	return;
 
-    // Set end of added partition to current end location
-    render_state->master_params[num_compute_procs_active].node_end_x = render_state->master_params[num_compute_procs_active-1].node_end_x;
-    
-    // Divide the current last partition in half
-    float new_x = render_state->master_params[num_compute_procs_active-1].node_start_x + length*0.5;
-    render_state->master_params[num_compute_procs_active-1].node_end_x = new_x;
-    render_state->master_params[num_compute_procs_active].node_start_x = new_x;
-
     // Set active to true for added rank
     render_state->master_params[num_compute_procs_active].active = true;
 
@@ -469,7 +451,81 @@ void toggle_liquid(render_t *state)
     state->liquid = !state->liquid;
 }
 
+void toggle_blur(render_t *state)
+{
+    state->dual_blur = !state->dual_blur;
+}
+
 void toggle_quit_mode(render_t *state)
 {
     state->quit_mode = !state->quit_mode;
 }
+
+// Keep the view within the simulation world
+static void clamp_view(render_t *state)
+{
+    static const float max_zoom = 8.0f;
+
+    if(state->view_zoom < 1.0f)
+        state->view_zoom = 1.0f;
+    else if(state->view_zoom > max_zoom)
+        state->view_zoom = max_zoom;
+
+    float half_width = state->sim_width*0.5f/state->view_zoom;
+    float half_height = state->sim_height*0.5f/state->view_zoom;
+
+    if(state->view_center_x < half_width)
+        state->view_center_x = half_width;
+    else if(state->view_center_x > state->sim_width - half_width)
+        state->view_center_x = state->sim_width - half_width;
+
+    if(state->view_center_y < half_height)
+        state->view_center_y = half_height;
+    else if(state->view_center_y > state->sim_height - half_height)
+        state->view_center_y = state->sim_height - half_height;
+}
+
+// Show the entire simulation world
+void reset_view(render_t *state)
+{
+    state->view_zoom = 1.0f;
+    state->view_center_x = state->sim_width*0.5f;
+    state->view_center_y = state->sim_height*0.5f;
+}
+
+void zoom_in(render_t *state)
+{
+    state->view_zoom *= 1.25f;
+    clamp_view(state);
+}
+
+void zoom_out(render_t *state)
+{
+    state->view_zoom /= 1.25f;
+    clamp_view(state);
+}
+
+// Pan by a tenth of the view
+void pan_left(render_t *state)
+{
+    state->view_center_x -= 0.1f*state->sim_width/state->view_zoom;
+    clamp_view(state);
+}
+
+void pan_right(render_t *state)
+{
+    state->view_center_x += 0.1f*state->sim_width/state->view_zoom;
+    clamp_view(state);
+}
+
+void pan_up(render_t *state)
+{
+    state->view_center_y += 0.1f*state->sim_height/state->view_zoom;
+    clamp_view(state);
+}
+
+void pan_down(render_t *state)
+{
+    state->view_center_y -= 0.1f*state->sim_height/state->view_zoom;
+    clamp_view(state);
+}
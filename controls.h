@@ -56,6 +56,14 @@ void toggle_pause(render_t *state);
 void set_mover_gl_center(render_t *render_state, float ogl_x, float ogl_y);
 void toggle_quit_mode(render_t *state);
 void toggle_liquid(render_t *state);
+void toggle_blur(render_t *state);
 void reset_mover_size(render_t *render_state);
+void reset_view(render_t *state);
+void zoom_in(render_t *state);
+void zoom_out(render_t *state);
+void pan_left(render_t *state);
+void pan_right(render_t *state);
+void pan_up(render_t *state);
+void pan_down(render_t *state);
 
 #endif
@@ -244,6 +244,33 @@ void handle_key(gl_t *state, struct input_event *event)
             case KEY_L:
                 toggle_liquid(render_state);
                 break;
+            case KEY_K:
+                toggle_blur(render_state);
+                break;
+            case KEY_EQUAL:
+            case KEY_KPPLUS:
+                zoom_in(render_state);
+                break;
+            case KEY_MINUS:
+            case KEY_KPMINUS:
+                zoom_out(render_state);
+                break;
+            case KEY_KP4:
+                pan_left(render_state);
+                break;
+            case KEY_KP6:
+                pan_right(render_state);
+                break;
+            case KEY_KP8:
+                pan_up(render_state);
+                break;
+            case KEY_KP2:
+                pan_down(render_state);
+                break;
+            case KEY_0:
+            case KEY_KP0:
+                reset_view(render_state);
+                break;
             case BTN_BACK:
                 toggle_dividers(render_state);
                 break;
@@ -33,6 +33,10 @@ THE SOFTWARE.
 #include "geometry.h"
 #include "fluid.h"
 #include "communication.h"
+#include "frame_stream.h"
+#include "checkpoint.h"
+#include "balance.h"
+#include "scene.h"
 
 #ifdef LIGHT
 #include "rgb_light.h"
@@ -48,18 +52,24 @@ int main(int argc, char *argv[])
     int return_value;
 
     // Initialize MPI
+    #ifdef PROGRESS_THREAD
+    // Compute ranks call MPI from a progress thread as well as the main thread
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    #else
     MPI_Init(&argc, &argv);
+    #endif
     int rank;
 
-    // Rank in world space
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-
     create_communicators();
 
+    // Rank in world space
+    MPI_Comm_rank(MPI_COMM_SIM, &rank);
+
     createMpiTypes();
 
-    // Rank 0 is the render node, otherwise a simulation node
-    if(rank == 0)
+    // The first NUM_RENDER_PROCS ranks are render nodes, otherwise a simulation node
+    if(rank < NUM_RENDER_PROCS)
         return_value = start_renderer();
     else
         start_simulation();
@@ -78,15 +88,17 @@ void start_simulation()
     printf("compute rank: %d, num compute procs: %d \n",rank, nprocs);
 
     param params;
-    AABB_t water_volume_global;
+    scene_t scene;
     AABB_t boundary_global;
     edge_t edges;
     oob_t out_of_bounds;
+    comm_graph_t comm_graph;
 
     unsigned int i;
 
     params.tunable_params.kill_sim = false;
     params.tunable_params.active = true;
+    params.tunable_params.density_field = false;
     params.tunable_params.g = 6.0f;
     params.tunable_params.time_step = 1.0f/30.0f;
     params.tunable_params.k = 0.2f;
@@ -98,89 +110,122 @@ void start_simulation()
     params.tunable_params.mover_width = 2.0f;
     params.tunable_params.mover_height = 2.0f;
     params.tunable_params.mover_type = SPHERE_MOVER;
-
     #ifdef RASPI
-    int steps_per_frame = 1; // Number of steps to compute before updating render node
+    params.tunable_params.halo_refresh_fraction = 0.25f;
     #else
-    int steps_per_frame = 4;
-    params.tunable_params.time_step /= (float)steps_per_frame;
+    params.tunable_params.halo_refresh_fraction = 0.1f;
     #endif
 
-    // The number of particles used may differ slightly
+    // Scene file may replace the initial parameters
+    read_scene(&scene, &params);
+
     #ifdef RASPI
-    params.number_fluid_particles_global = 1500;
+    int steps_per_frame = 1; // Number of steps to compute before updating render node
     #else
-    params.number_fluid_particles_global = 1500;
+    int steps_per_frame = 4;
+    params.tunable_params.time_step /= (float)steps_per_frame;
     #endif
 
     // Boundary box
     // This simulation assumes in various spots min is 0.0
     boundary_global.min_x = 0.0f;
-    boundary_global.max_x = 15.0f;
+    boundary_global.max_x = scene.width;
     boundary_global.min_y = 0.0f;
 
     // Receive aspect ratio to scale world y max
     short pixel_dims[2];
     float aspect_ratio;
-    MPI_Bcast(pixel_dims, 2, MPI_SHORT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(pixel_dims, 2, MPI_SHORT, 0, MPI_COMM_SIM);
     aspect_ratio = (float)pixel_dims[0]/(float)pixel_dims[1];
-    boundary_global.max_y = boundary_global.max_x / aspect_ratio;
-
-    // water volume
-    water_volume_global.min_x = 0.0f;
-    water_volume_global.max_x = boundary_global.max_x;
-    water_volume_global.min_y = 0.0f;
-    water_volume_global.max_y = boundary_global.max_y;
+    if(scene.height > 0.0f)
+        boundary_global.max_y = scene.height;
+    else
+        boundary_global.max_y = boundary_global.max_x / aspect_ratio;
 
-    params.number_halo_particles = 0;
+    // The render node initially shows the entire world
+    params.tunable_params.view_min_x = boundary_global.min_x;
+    params.tunable_params.view_min_y = boundary_global.min_y;
+    params.tunable_params.view_max_x = boundary_global.max_x;
+    params.tunable_params.view_max_y = boundary_global.max_y;
 
-    int start_x;  // where in x direction this nodes particles start
-    int number_particles_x; // number of particles in x direction for this node
+    // Fluid volumes fill the world if the scene has none, sets the initial spacing between particles
+    finalize_scene(&scene, &boundary_global);
+    params.number_obstacles = scene.number_obstacles;
+    params.obstacles = scene.obstacles;
 
-    // Fluid area in initial configuration
-    float area = (water_volume_global.max_x - water_volume_global.min_x) * (water_volume_global.max_y - water_volume_global.min_y);
+    params.number_halo_particles = 0;
 
-    // Initial spacing between particles
-    float spacing_particle = pow(area/params.number_fluid_particles_global,1.0/2.0);
+    int column_start;  // first lattice column of this nodes particles
+    int number_columns; // number of lattice columns for this node
 
     // Divide problem set amongst nodes
-    partitionProblem(&boundary_global, &water_volume_global, &start_x, &number_particles_x, spacing_particle, &params);
+    partitionProblem(&boundary_global, &scene, &column_start, &number_columns, &params);
 
-    // Set local/global number of particles to allocate
-    setParticleNumbers(&boundary_global, &water_volume_global, &edges, &out_of_bounds, number_particles_x, spacing_particle, &params);
-
-    // We will allocate enough room for all particles on single node
+    // By default we allocate enough room for all particles on single node
     // We also must take into account halo particles are placed onto the end of the max particle index
     // So this value can be even greater than the number of global
     // Before reaching this point the program should, but doesn't, intelligenly clean up fluid_particles
-    int max_fluid_particles_local = 2*params.number_fluid_particles_global;
+    // Large scenes lower the capacity so each rank only has room for its share
+    int max_fluid_particles_local = ceil(scene.capacity*params.number_fluid_particles_global);
 
     // Smoothing radius, h
-    params.tunable_params.smoothing_radius = 2.0f*spacing_particle;
+    params.tunable_params.smoothing_radius = 2.0f*scene.spacing;
 
     printf("smoothing radius: %f\n", params.tunable_params.smoothing_radius);
 
-    // Send initial world dimensions and max particle count to render node
+    #ifdef CHECKPOINT
+    // Restart from the last checkpoint if there is one, its particle count and parameters replace the initial ones
+    bool restart = read_checkpoint_header(&params);
+    if(restart)
+        max_fluid_particles_local = ceil(scene.capacity*params.number_fluid_particles_global);
+    #endif
+    params.max_fluid_particles_local = max_fluid_particles_local;
+
+    // Set local number of particles to allocate
+    setParticleNumbers(&edges, &out_of_bounds, &params);
+
+    // A rank never holds more than every particle, so frames need no more room than the smaller of the two
+    int max_frame_particles = max_fluid_particles_local < params.number_fluid_particles_global ?
+                              max_fluid_particles_local : params.number_fluid_particles_global;
+
+    // Send initial world dimensions, max particle count, and obstacles to render nodes
     if(rank == 0) {
         float world_dims[2];
         world_dims[0] = boundary_global.max_x;
         world_dims[1] = boundary_global.max_y;
-        MPI_Send(world_dims, 2, MPI_FLOAT, 0, 8, MPI_COMM_WORLD);
-	MPI_Send(&params.number_fluid_particles_global, 1, MPI_INT, 0, 9, MPI_COMM_WORLD);
+        for(i=0; i<NUM_RENDER_PROCS; i++) {
+            MPI_Send(world_dims, 2, MPI_FLOAT, i, 8, MPI_COMM_SIM);
+	    MPI_Send(&max_frame_particles, 1, MPI_INT, i, 9, MPI_COMM_SIM);
+            MPI_Send(&scene.number_obstacles, 1, MPI_INT, i, 10, MPI_COMM_SIM);
+            MPI_Send(scene.obstacles, scene.number_obstacles*sizeof(AABB_t), MPI_BYTE, i, 11, MPI_COMM_SIM);
+        }
     }
 
+    // Window on the render node that particle coordinates are put into
+    // Liquid density field dimensions are received from the render node
+    frame_window_t frame_window;
+    float field_dims[3];
+    create_frame_window(&frame_window, nprocs, max_frame_particles, field_dims, NULL);
+
     // Neighbor grid setup
     neighbor_grid_t neighbor_grid;
     neighbor_grid.max_bucket_size = 100;
     neighbor_grid.max_neighbors = neighbor_grid.max_bucket_size*4;
     neighbor_grid.spacing = params.tunable_params.smoothing_radius;
 
+    // Graph of ranks to exchange halo and out of bounds particles with
+    init_comm_graph(&comm_graph);
+
     size_t total_bytes = 0;
     size_t bytes;
     // Allocate fluid particles array
     bytes = max_fluid_particles_local * sizeof(fluid_particle);
     total_bytes+=bytes;
+    #ifdef SHM_HALO
+    fluid_particle *fluid_particles = create_shared_particles(&edges, &comm_graph, max_fluid_particles_local);
+    #else
     fluid_particle *fluid_particles = malloc(bytes);
+    #endif
     if(fluid_particles == NULL)
         printf("Could not allocate fluid_particles\n");
 
@@ -224,19 +269,41 @@ void start_simulation()
     if(grid_buckets == NULL || bucket_particles == NULL)
         printf("Could not allocate hash\n");
 
-    // Allocate edge index arrays
-    edges.edge_pointers_left = malloc(edges.max_edge_particles * sizeof(fluid_particle*));
-    edges.edge_pointers_right = malloc(edges.max_edge_particles * sizeof(fluid_particle*));
-    // Allocate out of bound index arrays
-    out_of_bounds.oob_pointer_indicies_left = malloc(out_of_bounds.max_oob_particles * sizeof(int));
-    out_of_bounds.oob_pointer_indicies_right = malloc(out_of_bounds.max_oob_particles * sizeof(int));
-    out_of_bounds.vacant_indicies = malloc(2*out_of_bounds.max_oob_particles * sizeof(int));
+    // Allocate edge send buffer and per neighbor counts
+    edges.send_particles = malloc(edges.max_edge_particles * sizeof(fluid_particle));
+    edges.send_counts = malloc(nprocs * sizeof(int));
+    edges.send_displs = malloc(nprocs * sizeof(int));
+    edges.recv_counts = malloc(nprocs * sizeof(int));
+    edges.recv_displs = malloc(nprocs * sizeof(int));
+    edges.send_header = malloc(2 * nprocs * sizeof(int));
+    edges.recv_header = malloc(2 * nprocs * sizeof(int));
+    edges.recv_particles = malloc(max_fluid_particles_local * sizeof(fluid_particle));
+    edges.edge_indicies = malloc(max_fluid_particles_local * sizeof(int));
+    edges.edge_positions = malloc(2 * max_fluid_particles_local * sizeof(float));
+    edges.number_edge_particles = 0;
+    edges.halo_counts = malloc(nprocs * sizeof(int));
+    edges.refresh_wanted = malloc(nprocs * sizeof(bool));
+    edges.refresh = malloc(nprocs * sizeof(bool));
+    edges.reqs = malloc(2 * nprocs * sizeof(MPI_Request));
+    // Allocate out of bound destination and vacancy arrays
+    out_of_bounds.destinations = malloc(max_fluid_particles_local * sizeof(int));
+    out_of_bounds.vacant_indicies = malloc(max_fluid_particles_local * sizeof(int));
 
     printf("bytes allocated: %lu\n", total_bytes);
 
     // Initialize particles
-    initParticles(fluid_particle_pointers, fluid_particles, &water_volume_global, start_x,
-		  number_particles_x, &edges, max_fluid_particles_local, spacing_particle, &params);
+    initParticles(fluid_particle_pointers, fluid_particles, &scene, &boundary_global, column_start,
+                  number_columns, max_fluid_particles_local, &params);
+
+    #ifdef CHECKPOINT
+    // Particles of the checkpoint are re-partitioned over the active ranks by x
+    if(restart)
+        read_checkpoint(fluid_particle_pointers, fluid_particles, max_fluid_particles_local, &boundary_global, &params);
+    #endif
+
+    // Split the world into strips from the initial partitions and build the graph from them
+    init_strips(&comm_graph, &boundary_global, &params);
+    update_comm_graph(fluid_particle_pointers, &comm_graph, &params);
 
     // Print some parameters
     printf("Rank: %d, fluid_particles: %d, smoothing radius: %f \n", rank, params.number_fluid_particles_local, params.tunable_params.smoothing_radius);
@@ -245,15 +312,18 @@ void start_simulation()
     tunable_parameters *null_tunable_param = NULL;
     int *null_recvcnts = NULL;
     int *null_displs = NULL;
-    MPI_Gatherv(&params.tunable_params, 1, TunableParamtype, null_tunable_param, null_recvcnts, null_displs, TunableParamtype, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(&params.tunable_params, 1, TunableParamtype, null_tunable_param, null_recvcnts, null_displs, TunableParamtype, 0, MPI_COMM_SIM);
 
     // Initialize RGB Light if present
     #if defined LIGHT || defined BLINK1
     rgb_light_t light_state;
     float *colors_by_rank = malloc(3*nprocs*sizeof(float));
-    MPI_Bcast(colors_by_rank, 3*nprocs, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(colors_by_rank, 3*nprocs, MPI_FLOAT, 0, MPI_COMM_SIM);
     init_rgb_light(&light_state, 255*colors_by_rank[3*rank], 255*colors_by_rank[3*rank+1], 255*colors_by_rank[3*rank+2]);
     free(colors_by_rank);
+    // Spare ranks show white until added to the simulation
+    if(!params.tunable_params.active)
+        rgb_light_white(&light_state);
     // Without this pause the lights can sometimes change color too quickly the first time step
     sleep(1);
     #endif    
@@ -262,13 +332,29 @@ void start_simulation()
     fluid_particle *null_particle = NULL;
     float *null_float = NULL;
 
-    MPI_Request coords_req = MPI_REQUEST_NULL;
-
     int sub_step = 0; // substep range from 0 to < steps_per_frame
 
+    // Parameters are received from the render node without blocking
+    param_channel_t param_channel;
+    init_param_receiver(&param_channel);
+
+    #ifdef PROGRESS_THREAD
+    // Progress the particle exchange while staying particles are hashed
+    progress_t progress;
+    start_progress_thread(&progress);
+    #endif
+
+    // Partitions are balanced on the work and compute time of each rank
+    // Time spent computing, not communicating, is measured for it
+    balance_t balance;
+    init_balance(&balance, &comm_graph);
+    double compute_start;
+
     // Main simulation loop
     while(1) {
 
+        compute_start = MPI_Wtime();
+
         // Initialize velocities
         apply_gravity(fluid_particle_pointers, &params);
 
@@ -278,45 +364,55 @@ void start_simulation()
         // Advance to predicted position and set OOB particles
         predict_positions(fluid_particle_pointers, &boundary_global, &params);
 
-        // Make sure that async send to render node is complete
-        if(sub_step == 0)
-        {
-            if(coords_req != MPI_REQUEST_NULL)
-	        MPI_Wait(&coords_req, MPI_STATUS_IGNORE);
-        }
-
-        #if defined LIGHT || defined BLINK1
-        char previously_active = params.tunable_params.active;
-        #endif
-
-        // Receive updated paramaters from render nodes
-        if(sub_step == steps_per_frame-1)
-            MPI_Scatterv(null_tunable_param, 0, null_displs, TunableParamtype, &params.tunable_params, 1, TunableParamtype, 0,  MPI_COMM_WORLD);
-
-        #if defined LIGHT || defined BLINK1
-        // If recently added to computation turn light to light state color
-        // If recently taken out of computation turn light to white
-        char currently_active = params.tunable_params.active;
-        if (!previously_active && currently_active)
-            rgb_light_reset(&light_state);
-        else if (!currently_active && previously_active)
-            rgb_light_white(&light_state);
-        #endif
-
-        if(params.tunable_params.kill_sim)
-            break;
+        balance.compute_time += MPI_Wtime() - compute_start;
+
+        // Apply the newest paramaters from the render node, which may have added or removed ranks
+        // A removed rank leaves once its particles have moved and idles until it's added back
+        if(sub_step == steps_per_frame-1) {
+            #if defined LIGHT || defined BLINK1
+            char previously_active = params.tunable_params.active;
+            #endif
+
+            bool member = update_active_ranks(&comm_graph, &param_channel, &params, &frame_window);
+
+            #if defined LIGHT || defined BLINK1
+            // If recently added to computation turn light to light state color
+            // If recently taken out of computation turn light to white
+            char currently_active = params.tunable_params.active;
+            if (!previously_active && currently_active)
+                rgb_light_reset(&light_state);
+            else if (!currently_active && previously_active)
+                rgb_light_white(&light_state);
+            #endif
+
+            // Ranks that have left wait to be told the simulation has ended
+            if(!member) {
+                if(!wait_while_idle(&comm_graph, &param_channel, &params.tunable_params, &frame_window))
+                    break;
+                balance.steps = 0;
+                balance.compute_time = 0.0;
+                #if defined LIGHT || defined BLINK1
+                rgb_light_reset(&light_state);
+                #endif
+            }
 
-        // Identify out of bounds particles and send them to appropriate rank
-        identify_oob_particles(fluid_particle_pointers, fluid_particles, &out_of_bounds, &boundary_global, &params);
+            if(params.tunable_params.kill_sim)
+                break;
+            update_comm_graph(fluid_particle_pointers, &comm_graph, &params);
+        }
 
         // Hash the non halo regions
         // This will update the densities so when the halo is exchanged the halo particles are up to date
         // This works well on the raspi's but destroys communication/computation overlap
+        compute_start = MPI_Wtime();
         hash_fluid(fluid_particle_pointers, &neighbor_grid, &params, true);
+        balance.compute_time += MPI_Wtime() - compute_start;
 
          // Exchange halo particles
-        startHaloExchange(fluid_particle_pointers,fluid_particles, &edges, &params);
-        finishHaloExchange(fluid_particle_pointers,fluid_particles, &edges, &params);
+        startHaloExchange(fluid_particle_pointers,fluid_particles, &edges, &comm_graph, &params);
+        finishHaloExchange(fluid_particle_pointers,fluid_particles, &edges, &comm_graph, &params);
+
+        compute_start = MPI_Wtime();
 
         // Add the halo particles to neighbor buckets
         // Also update density
@@ -329,39 +425,90 @@ void start_simulation()
         // update velocity
         updateVelocities(fluid_particle_pointers, &edges, &boundary_global, &params);
 
-        // Not updating halo particles and hash after relax can be used to speed things up
-        // Not updating these can cause unstable behavior
-
-        #ifndef RASPI
-        // Exchange halo particles from relaxed positions
-        startHaloExchange(fluid_particle_pointers,fluid_particles, &edges, &params);
-        #endif
-
-        // We can hash during exchange as the density is not needed
-        hash_fluid(fluid_particle_pointers, &neighbor_grid, &params, false);
-
-        #ifndef RASPI
-        // Finish asynch halo exchange
-        finishHaloExchange(fluid_particle_pointers,fluid_particles, &edges, &params);
+        balance.compute_time += MPI_Wtime() - compute_start;
+
+        // Send particles that have left the partition and exchange halo particles from relaxed positions
+        // Only neighbors with an edge particle that has moved far, or left, since the halo was sent exchange, the others keep their current halo
+        // Not updating halo particles after relax can cause unstable behavior if the fraction of h allowed is too large
+        // We can hash the particles staying during the exchange as the density is not needed, those received are added after
+        if(halo_refresh_needed(fluid_particle_pointers, &edges, &comm_graph, &params)) {
+            startParticleExchange(fluid_particle_pointers, fluid_particles, &out_of_bounds, &edges, &comm_graph, &params);
+            #ifdef PROGRESS_THREAD
+            resume_progress_thread(&progress);
+            #endif
+
+            compute_start = MPI_Wtime();
+            hash_fluid(fluid_particle_pointers, &neighbor_grid, &params, false);
+            balance.compute_time += MPI_Wtime() - compute_start;
+
+            #ifdef PROGRESS_THREAD
+            pause_progress_thread(&progress);
+            #endif
+            int num_staying = params.number_fluid_particles_local;
+            finishParticleExchange(fluid_particle_pointers, fluid_particles, &out_of_bounds, &edges, &comm_graph, &params);
+
+            compute_start = MPI_Wtime();
+            hash_arrivals(fluid_particle_pointers, &neighbor_grid, &params, num_staying);
+        }
+        else {
+            compute_start = MPI_Wtime();
+            hash_fluid(fluid_particle_pointers, &neighbor_grid, &params, false);
+        }
 
-        // Update hash with relaxed positions
+        // Update hash with relaxed halo positions
         hash_halo(fluid_particle_pointers, &neighbor_grid, &params, false);
-        #endif
-
-        // We do not transfer particles that have gone OOB since relaxation
-        // to reduce communication cost
+        balance.compute_time += MPI_Wtime() - compute_start;
+        balance.steps++;
+
+        // Move strips between ranks to even out the time each rank spends computing
+        // Particles move to their new owners over the following steps
+        // Members must agree on when to balance, ranks joining do so at the last sub-step of a frame
+        if((sub_step+1) % BALANCE_STEPS == 0 || sub_step == steps_per_frame-1) {
+            if(balance_partitions(fluid_particle_pointers, neighbors, &boundary_global, &comm_graph, &params, &balance))
+                update_comm_graph(fluid_particle_pointers, &comm_graph, &params);
+        }
 
-        // Pack fluid particle coordinates
-        // This sends results as short in pixel coordinates
-        if(sub_step == steps_per_frame-1)
+        // Pack fluid particle coordinates within each render nodes tile of the view
+        // This sends results as short in tile coordinates, the full short range covers the tile plus a margin
+        // A frame is dropped, rather than waited on, if the render node still holds the one last put into its buffer
+        if(sub_step == steps_per_frame-1 && frame_window.deliver)
         {
-            for(i=0; i<params.number_fluid_particles_local; i++) {
-                p = fluid_particle_pointers[i];
-                fluid_particle_coords[i*2] = (2.0f*p->x/boundary_global.max_x - 1.0f) * SHRT_MAX; // convert to short using full range
-                fluid_particle_coords[(i*2)+1] = (2.0f*p->y/boundary_global.max_y - 1.0f) * SHRT_MAX; // convert to short using full range
+            float tile_half_width = 0.5f*(params.tunable_params.view_max_x - params.tunable_params.view_min_x)/RENDER_TILES_X;
+            float tile_half_height = 0.5f*(params.tunable_params.view_max_y - params.tunable_params.view_min_y)/RENDER_TILES_Y;
+            float tile_x, tile_y;
+            int tile, num_coords;
+
+            // The render node draws dividers from the partitions put with each slot
+            frame_window.partition[0] = params.tunable_params.node_start_x;
+            frame_window.partition[1] = params.tunable_params.node_end_x;
+
+            for(tile=0; tile<NUM_RENDER_PROCS; tile++) {
+                float tile_min_x = params.tunable_params.view_min_x + (tile%RENDER_TILES_X)*2.0f*tile_half_width;
+                float tile_min_y = params.tunable_params.view_min_y + (tile/RENDER_TILES_X)*2.0f*tile_half_height;
+                num_coords = 0;
+                for(i=0; i<params.number_fluid_particles_local; i++) {
+                    p = fluid_particle_pointers[i];
+                    tile_x = (p->x - tile_min_x)/tile_half_width - 1.0f;
+                    tile_y = (p->y - tile_min_y)/tile_half_height - 1.0f;
+                    if(fabsf(tile_x) > FRAME_COORD_SCALE || fabsf(tile_y) > FRAME_COORD_SCALE)
+                        continue;
+                    fluid_particle_coords[num_coords++] = tile_x/FRAME_COORD_SCALE * SHRT_MAX; // convert to short using full range
+                    fluid_particle_coords[num_coords++] = tile_y/FRAME_COORD_SCALE * SHRT_MAX; // convert to short using full range
+                }
+                // Put fluid particle coordinates, or their liquid density tile, into the render nodes frame window
+                if(params.tunable_params.density_field)
+                    put_frame_field(&frame_window, tile, fluid_particle_coords, num_coords, params.number_fluid_particles_local);
+                else
+                    put_frame(&frame_window, tile, fluid_particle_coords, num_coords, params.number_fluid_particles_local);
             }
-            // Async send fluid particle coordinates to render node
-            MPI_Isend(fluid_particle_coords, 2*params.number_fluid_particles_local, MPI_SHORT, 0, 17, MPI_COMM_WORLD, &coords_req);
+            put_idle_frames(&frame_window, &comm_graph);
+            end_frame(&frame_window);
+
+            #ifdef CHECKPOINT
+            // Members agree on the frame so they all write the same checkpoints
+            if(frame_window.frame % CHECKPOINT_FRAMES == 0)
+                write_checkpoint(fluid_particle_pointers, edges.recv_particles, comm_graph.active_comm, &params);
+            #endif
         }
 
         if(sub_step == steps_per_frame-1)
@@ -371,23 +518,48 @@ void start_simulation()
 
     }
 
+    #ifdef PROGRESS_THREAD
+    stop_progress_thread(&progress);
+    #endif
+
     #if defined LIGHT || defined BLINK1
         shutdown_rgb_light(&light_state);
     #endif
 
+    release_idle_ranks(&comm_graph);
+    close_param_channel(&param_channel);
+    free_frame_window(&frame_window);
+
     // Release memory
+    #ifdef SHM_HALO
+    free_shared_particles(&edges);
+    #else
     free(fluid_particles);
+    #endif
     free(fluid_particle_coords);
     free(fluid_particle_pointers);
     free(neighbors);
     free(fluid_neighbors);
     free(grid_buckets);
     free(bucket_particles);
-    free(edges.edge_pointers_left);
-    free(edges.edge_pointers_right);
-    free(out_of_bounds.oob_pointer_indicies_left);
-    free(out_of_bounds.oob_pointer_indicies_right);
+    free(edges.send_particles);
+    free(edges.send_counts);
+    free(edges.send_displs);
+    free(edges.recv_counts);
+    free(edges.recv_displs);
+    free(edges.send_header);
+    free(edges.recv_header);
+    free(edges.recv_particles);
+    free(edges.edge_indicies);
+    free(edges.edge_positions);
+    free(edges.halo_counts);
+    free(edges.refresh_wanted);
+    free(edges.refresh);
+    free(edges.reqs);
+    free(out_of_bounds.destinations);
     free(out_of_bounds.vacant_indicies);
+    free_balance(&balance);
+    free_comm_graph(&comm_graph);
 
     // Close MPI
     freeMpiTypes();
@@ -477,32 +649,6 @@ void viscosity_impluses(fluid_particle **fluid_particle_pointers, neighbor* neig
     }
 }
 
-// Identify out of bounds particles and send them to appropriate rank
-void identify_oob_particles(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, AABB_t *boundary_global, param *params)
-{
-    int i;
-    fluid_particle *p;
-
-    // Reset OOB numbers
-    out_of_bounds->number_oob_particles_left = 0;
-    out_of_bounds->number_oob_particles_right = 0;
-
-    for(i=0; i<params->number_fluid_particles_local; i++) {
-        p = fluid_particle_pointers[i];
-
-        // Set OOB particle indicies and update number
-        if (p->x < params->tunable_params.node_start_x)
-            out_of_bounds->oob_pointer_indicies_left[out_of_bounds->number_oob_particles_left++] = i;
-        else if (p->x > params->tunable_params.node_end_x)
-            out_of_bounds->oob_pointer_indicies_right[out_of_bounds->number_oob_particles_right++] = i;
-    }
- 
-   // Transfer particles that have left the processor bounds
-   transferOOBParticles(fluid_particle_pointers, fluid_particles, out_of_bounds, params);
-}
-
-
-
 // Predict position
 void predict_positions(fluid_particle **fluid_particle_pointers, AABB_t *boundary_global, param *params)
 {
@@ -612,16 +758,14 @@ void double_density_relaxation(fluid_particle **fluid_particle_pointers, neighbo
 
 void checkVelocity(float *v_x, float *v_y)
 {
-    const float v_max = 5.0f;
-
-    if(*v_x > v_max)
-        *v_x = v_max;
-    else if(*v_x < -v_max)
-        *v_x = -v_max;
-    if(*v_y > v_max)
-        *v_y = v_max;
-    else if(*v_y < -v_max)
-        *v_y = -v_max;
+    if(*v_x > MAX_VELOCITY)
+        *v_x = MAX_VELOCITY;
+    else if(*v_x < -MAX_VELOCITY)
+        *v_x = -MAX_VELOCITY;
+    if(*v_y > MAX_VELOCITY)
+        *v_y = MAX_VELOCITY;
+    else if(*v_y < -MAX_VELOCITY)
+        *v_y = -MAX_VELOCITY;
 }
 
 void updateVelocity(fluid_particle *p, param *params)
@@ -687,45 +831,19 @@ void boundaryConditions(fluid_particle *p, AABB_t *boundary, param *params)
     // Boundary condition for rectangle mover
     else if(params->tunable_params.mover_type == RECTANGLE_MOVER)
     {
-        float half_width = params->tunable_params.mover_width*0.5;
-        float half_height = params->tunable_params.mover_height*0.5;
-
-        // Particle possition relative to mover center
-        float pos_center_x = p->x - center_x;
-        float pos_center_y = p->y - center_y;
-
-        // Distance from particle to mover center
-	float dist_center_x = fabs(pos_center_x);
-	float dist_center_y = fabs(pos_center_y);  
-
-	// Test if inside rectangle
-        if( dist_center_x < half_width && dist_center_y < half_height)
-        {
-            // To find where penetrated from we assume
-            // particle is closest to penetrated side
-
-            // Particle penetration depth into rectangle
-            float pen_depth_x = half_width - dist_center_x;
-            float pen_depth_y = half_height - dist_center_y;
-
-            // Particle closer to left/right sides
-            if(pen_depth_x < pen_depth_y){
-                // Entered left side
-                if(pos_center_x < 0.0f)
-                    p->x -= pen_depth_x;
-                else // Entered right side
-                    p->x += pen_depth_x;
-            }
-            else { // Particle closer to top/bottom
-                // Entered bottom
-                if(pos_center_y < 0.0f)
-                    p->y -= pen_depth_y;
-                else // Entered top
-                    p->y += pen_depth_y;
-            }
-        }
+        AABB_t mover;
+        mover.min_x = center_x - params->tunable_params.mover_width*0.5;
+        mover.max_x = center_x + params->tunable_params.mover_width*0.5;
+        mover.min_y = center_y - params->tunable_params.mover_height*0.5;
+        mover.max_y = center_y + params->tunable_params.mover_height*0.5;
+        boxCollision(p, &mover);
     }
 
+    // Static obstacles from the scene
+    int i;
+    for(i=0; i<params->number_obstacles; i++)
+        boxCollision(p, &params->obstacles[i]);
+
     // Make sure object is not outside boundary
     // The particle must not be equal to boundary max or hash potentially won't pick it up
     // as the particle will in the 'next' after last bin
@@ -744,15 +862,57 @@ void boundaryConditions(fluid_particle *p, AABB_t *boundary, param *params)
 }
 
 // Initialize particles
+// Push a particle inside of box out of the side it's closest to
+void boxCollision(fluid_particle *p, AABB_t *box)
+{
+    float half_width = (box->max_x - box->min_x)*0.5f;
+    float half_height = (box->max_y - box->min_y)*0.5f;
+
+    // Particle possition relative to box center
+    float pos_center_x = p->x - (box->min_x + half_width);
+    float pos_center_y = p->y - (box->min_y + half_height);
+
+    // Distance from particle to box center
+    float dist_center_x = fabs(pos_center_x);
+    float dist_center_y = fabs(pos_center_y);
+
+    // Test if inside rectangle
+    if( dist_center_x < half_width && dist_center_y < half_height)
+    {
+        // To find where penetrated from we assume
+        // particle is closest to penetrated side
+
+        // Particle penetration depth into rectangle
+        float pen_depth_x = half_width - dist_center_x;
+        float pen_depth_y = half_height - dist_center_y;
+
+        // Particle closer to left/right sides
+        if(pen_depth_x < pen_depth_y){
+            // Entered left side
+            if(pos_center_x < 0.0f)
+                p->x -= pen_depth_x;
+            else // Entered right side
+                p->x += pen_depth_x;
+        }
+        else { // Particle closer to top/bottom
+            // Entered bottom
+            if(pos_center_y < 0.0f)
+                p->y -= pen_depth_y;
+            else // Entered top
+                p->y += pen_depth_y;
+        }
+    }
+}
+
 void initParticles(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,
-                   AABB_t *water, int start_x, int number_particles_x,    
-                   edge_t *edges, int max_fluid_particles_local, float spacing, param* params)
+                   scene_t *scene, AABB_t *boundary_global, int column_start, int number_columns,
+                   int max_fluid_particles_local, param* params)
 {
     int i;
-    fluid_particle *p;
 
     // Create fluid volume
-    constructFluidVolume(fluid_particle_pointers, fluid_particles, water, start_x, number_particles_x, edges, spacing, params);
+    constructFluidVolume(fluid_particle_pointers, fluid_particles, scene, boundary_global, column_start,
+                         number_columns, max_fluid_particles_local, params);
 
     // NULL out unused fluid pointers
     for(i=params->number_fluid_particles_local; i<max_fluid_particles_local; i++)
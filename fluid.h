@@ -48,6 +48,9 @@ typedef struct TUNABLE_PARAMETERS tunable_parameters;
 #define SPHERE_MOVER 0
 #define RECTANGLE_MOVER 1
 
+// Particle velocity components are clamped to this magnitude
+#define MAX_VELOCITY 5.0f
+
 ////////////////////////////////////////////////
 // Structures
 ////////////////////////////////////////////////
@@ -85,15 +88,21 @@ struct TUNABLE_PARAMETERS {
     float sigma;
     float beta;
     float time_step;
+    float halo_refresh_fraction; // Fraction of h an edge particle may move before the halo is refreshed after relaxation
     float node_start_x;
     float node_end_x;
     float mover_center_x;
     float mover_center_y;
     float mover_width;
     float mover_height;
+    float view_min_x;   // Region of the world shown by the render node, particles outside are not sent
+    float view_min_y;
+    float view_max_x;
+    float view_max_y;
     char mover_type;
     char kill_sim;
     char active;
+    char density_field; // Send liquid density tiles to the render node instead of coordinates
 };
 
 // Full parameters struct for simulation
@@ -101,8 +110,11 @@ struct PARAM {
     tunable_parameters tunable_params;
     int number_fluid_particles_global;
     int number_fluid_particles_local; // Number of non vacant particles not including halo
+    int max_fluid_particles_local;    // Room in the particle array, including halo
     int max_fluid_particle_index;     // Max index used in actual particle array
     int number_halo_particles;        // Starting at max_fluid_particle_index
+    int number_obstacles;             // Static boxes from the scene particles are kept out of
+    AABB_t *obstacles;
 }; // Simulation paramaters
 
 ////////////////////////////////////////////////
@@ -110,9 +122,10 @@ struct PARAM {
 ////////////////////////////////////////////////
 //void collisionImpulse(fluid_particle *p, float norm_x, float norm_y, param *params);
 void boundaryConditions(fluid_particle *p, AABB_t *boundary, param *params);
+void boxCollision(fluid_particle *p, AABB_t *box);
 void initParticles(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles,
-                   AABB_t *water, int start_x, int number_particles_x, 
-		   edge_t *edges, int max_fluid_particles_local, float spacing, param* params);
+                   scene_t *scene, AABB_t *boundary_global, int column_start, int number_columns,
+                   int max_fluid_particles_local, param* params);
 
 void start_simulation();
 void calculate_density(fluid_particle *p, fluid_particle *q, float ratio);
@@ -123,6 +136,5 @@ void double_density_relaxation(fluid_particle **fluid_particle_pointers, neighbo
 void updateVelocity(fluid_particle *p, param *params);
 void updateVelocities(fluid_particle **fluid_particle_pointers, edge_t *edges, AABB_t *boundary_global, param *params);
 void checkVelocity(float *v_x, float *v_y);
-void identify_oob_particles(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, oob_t *out_of_bounds, AABB_t *boundary_global, param *params);
 
 #endif
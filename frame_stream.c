@@ -0,0 +1,355 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include "frame_stream.h"
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#define FRAME_COORD_BITS (16 - FRAME_DROP_BITS)
+#define FRAME_OFFSET_BITS (FRAME_COORD_BITS - FRAME_CELL_BITS)
+#define FRAME_NUM_CELLS (1 << (2*FRAME_CELL_BITS))
+
+// Packed frame layout, for each non empty cell in increasing cell order:
+//  varint cell index delta from previous non empty cell minus one
+//  varint particle count minus one
+//  byte   x delta bit width in high nibble, y offset bit width in low nibble
+//  bits   x offsets sorted ascending and delta encoded, followed by y offsets, padded to a byte
+
+// Bit writer/reader, bits are filled starting from the least significant bit
+typedef struct BITS_T {
+    unsigned char *bytes;
+    unsigned long long buffer;
+    int num_bits;
+} bits_t;
+
+static void put_bits(bits_t *bits, unsigned int value, int width)
+{
+    bits->buffer |= (unsigned long long)value << bits->num_bits;
+    bits->num_bits += width;
+    while(bits->num_bits >= 8) {
+        *bits->bytes++ = bits->buffer & 0xFF;
+        bits->buffer >>= 8;
+        bits->num_bits -= 8;
+    }
+}
+
+static void flush_bits(bits_t *bits)
+{
+    if(bits->num_bits > 0)
+        *bits->bytes++ = bits->buffer & 0xFF;
+    bits->buffer = 0;
+    bits->num_bits = 0;
+}
+
+static void put_varint(bits_t *bits, unsigned int value)
+{
+    while(value >= 0x80) {
+        *bits->bytes++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *bits->bytes++ = value;
+}
+
+static unsigned int get_varint(const unsigned char **bytes)
+{
+    unsigned int value = 0;
+    int shift = 0;
+    while(**bytes & 0x80) {
+        value |= (unsigned int)(*(*bytes)++ & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= (unsigned int)(*(*bytes)++) << shift;
+    return value;
+}
+
+// Unpack count values of width bits starting at value first, each value is extracted without branching
+// Reads up to two bytes past the last value
+static void get_bits(const unsigned char *bytes, int first, unsigned int *values, int count, int width)
+{
+    int i;
+    unsigned int mask = (1u << width) - 1;
+    unsigned int bit, window;
+
+    for(i=0; i<count; i++) {
+        bit = (first + i) * width;
+        window = bytes[bit>>3] | (unsigned int)bytes[(bit>>3)+1] << 8 | (unsigned int)bytes[(bit>>3)+2] << 16;
+        values[i] = (window >> (bit & 7)) & mask;
+    }
+}
+
+static int bit_width(unsigned int value)
+{
+    int width = 0;
+    while(value) {
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+// Quantized, unsigned coordinate
+static unsigned int quantize(short coord)
+{
+    return ((unsigned int)(coord + 32768)) >> FRAME_DROP_BITS;
+}
+
+// Pack coordinate pairs into packed, scratch must be FRAME_PACK_SCRATCH(num_coords) bytes
+// Returns the number of bytes packed, or 0 if packing would not be smaller than the raw coordinates
+int pack_frame(const short *coords, int num_coords, unsigned char *packed, unsigned short *scratch)
+{
+    int i, j, cell, count, start;
+    unsigned int x, y, delta, max_delta, max_y;
+    int num_particles = num_coords/2;
+    int raw_bytes = num_coords * sizeof(short);
+    int cell_starts[FRAME_NUM_CELLS+1];
+
+    // Counting sort of particles by cell into scratch as (x,y) offset pairs
+    for(i=0; i<=FRAME_NUM_CELLS; i++)
+        cell_starts[i] = 0;
+    for(i=0; i<num_particles; i++) {
+        x = quantize(coords[2*i]);
+        y = quantize(coords[2*i+1]);
+        cell = (y >> FRAME_OFFSET_BITS) << FRAME_CELL_BITS | (x >> FRAME_OFFSET_BITS);
+        cell_starts[cell+1]++;
+    }
+    for(i=0; i<FRAME_NUM_CELLS; i++)
+        cell_starts[i+1] += cell_starts[i];
+    for(i=0; i<num_particles; i++) {
+        x = quantize(coords[2*i]);
+        y = quantize(coords[2*i+1]);
+        cell = (y >> FRAME_OFFSET_BITS) << FRAME_CELL_BITS | (x >> FRAME_OFFSET_BITS);
+        // cell_starts[cell] is used as a cursor and ends at the start of the next cell
+        j = cell_starts[cell]++;
+        scratch[2*j] = x & ((1 << FRAME_OFFSET_BITS) - 1);
+        scratch[2*j+1] = y & ((1 << FRAME_OFFSET_BITS) - 1);
+    }
+
+    bits_t bits = {packed, 0, 0};
+    int previous_cell = -1;
+    start = 0;
+    for(cell=0; cell<FRAME_NUM_CELLS; cell++) {
+        count = cell_starts[cell] - start;
+        if(!count)
+            continue;
+
+        // Worst case size of this cell, two bytes are left for the unpacker to read past the end
+        if((bits.bytes - packed) + 6 + 2*(count*FRAME_OFFSET_BITS + 7)/8 > raw_bytes - 2)
+            return 0;
+
+        unsigned short *particles = scratch + 2*start;
+
+        // Insertion sort cell particles by x, cells hold few particles
+        for(i=1; i<count; i++) {
+            unsigned short px = particles[2*i], py = particles[2*i+1];
+            for(j=i; j>0 && particles[2*(j-1)] > px; j--) {
+                particles[2*j] = particles[2*(j-1)];
+                particles[2*j+1] = particles[2*(j-1)+1];
+            }
+            particles[2*j] = px;
+            particles[2*j+1] = py;
+        }
+
+        max_delta = particles[0];
+        max_y = particles[1];
+        for(i=1; i<count; i++) {
+            delta = particles[2*i] - particles[2*(i-1)];
+            if(delta > max_delta)
+                max_delta = delta;
+            if(particles[2*i+1] > max_y)
+                max_y = particles[2*i+1];
+        }
+        int x_width = bit_width(max_delta);
+        int y_width = bit_width(max_y);
+
+        put_varint(&bits, cell - previous_cell - 1);
+        put_varint(&bits, count - 1);
+        *bits.bytes++ = x_width << 4 | y_width;
+
+        put_bits(&bits, particles[0], x_width);
+        for(i=1; i<count; i++)
+            put_bits(&bits, particles[2*i] - particles[2*(i-1)], x_width);
+        flush_bits(&bits);
+        for(i=0; i<count; i++)
+            put_bits(&bits, particles[2*i+1], y_width);
+        flush_bits(&bits);
+
+        previous_cell = cell;
+        start = cell_starts[cell];
+    }
+
+    return bits.bytes - packed;
+}
+
+// Unpack num_coords coordinates, the order of particles is not preserved
+void unpack_frame(const unsigned char *packed, int num_coords, short *coords)
+{
+    int i, count, cell_x, cell_y, x_width, y_width;
+    unsigned int x, x_base, y_base;
+    unsigned int x_values[1 << FRAME_OFFSET_BITS];
+    unsigned int y_values[1 << FRAME_OFFSET_BITS];
+    int num_particles = num_coords/2;
+    int cell = -1;
+    const int half_drop = (1 << FRAME_DROP_BITS) >> 1;
+
+    while(num_particles > 0) {
+        cell += get_varint(&packed) + 1;
+        count = get_varint(&packed) + 1;
+        x_width = *packed >> 4;
+        y_width = *packed & 0xF;
+        packed++;
+
+        cell_x = cell & ((1 << FRAME_CELL_BITS) - 1);
+        cell_y = cell >> FRAME_CELL_BITS;
+        x_base = cell_x << FRAME_OFFSET_BITS;
+        y_base = cell_y << FRAME_OFFSET_BITS;
+
+        // A cell larger than the value arrays is decoded in chunks
+        int remaining = count;
+        x = 0;
+        const unsigned char *x_bits = packed;
+        const unsigned char *y_bits = packed + (count*x_width + 7)/8;
+        int chunk, offset = 0;
+        while(remaining > 0) {
+            chunk = remaining < (1 << FRAME_OFFSET_BITS) ? remaining : (1 << FRAME_OFFSET_BITS);
+            get_bits(x_bits, offset, x_values, chunk, x_width);
+            get_bits(y_bits, offset, y_values, chunk, y_width);
+            for(i=0; i<chunk; i++) {
+                x += x_values[i];
+                coords[0] = (short)((int)(((x_base + x) << FRAME_DROP_BITS) + half_drop) - 32768);
+                coords[1] = (short)((int)(((y_base + y_values[i]) << FRAME_DROP_BITS) + half_drop) - 32768);
+                coords += 2;
+            }
+            offset += chunk;
+            remaining -= chunk;
+        }
+        packed = y_bits + (count*y_width + 7)/8;
+        num_particles -= count;
+    }
+}
+
+// Texel coordinate of a short coordinate along an axis of length texels
+static float coord_to_texel(short coord, float length)
+{
+    return (coord*FRAME_COORD_SCALE/(float)SHRT_MAX + 1.0f) * 0.5f * length;
+}
+
+// Splat coordinates into a density tile covering only the texels they touch
+// field_dims holds the field width and height and the particle diameter, all in texels
+// scratch must hold a float for every texel of the field, returns the number of bytes written to tile
+int splat_frame_field(const short *coords, int num_coords, const float *field_dims, float *scratch, unsigned char *tile)
+{
+    int i, tx, ty;
+    int field_width = (int)field_dims[0];
+    int field_height = (int)field_dims[1];
+    float radius = 0.5f * field_dims[2];
+    float reach = sqrtf(FRAME_FIELD_CUTOFF) * radius;
+    float inv_radius_squared = 1.0f/(radius*radius);
+    int header[FRAME_FIELD_HEADER] = {0, 0, 0, 0};
+
+    // Bounding box of texels within reach of any coordinate
+    float min_x = field_width, max_x = 0.0f, min_y = field_height, max_y = 0.0f;
+    float x, y;
+    for(i=0; i<num_coords; i+=2) {
+        x = coord_to_texel(coords[i], field_width);
+        y = coord_to_texel(coords[i+1], field_height);
+        if(x < min_x) min_x = x;
+        if(x > max_x) max_x = x;
+        if(y < min_y) min_y = y;
+        if(y > max_y) max_y = y;
+    }
+    int x0 = (int)floorf(min_x - reach);
+    int x1 = (int)ceilf(max_x + reach);
+    int y0 = (int)floorf(min_y - reach);
+    int y1 = (int)ceilf(max_y + reach);
+    if(x0 < 0) x0 = 0;
+    if(y0 < 0) y0 = 0;
+    if(x1 > field_width) x1 = field_width;
+    if(y1 > field_height) y1 = field_height;
+
+    if(num_coords > 0 && x1 > x0 && y1 > y0) {
+        header[0] = x0;
+        header[1] = y0;
+        header[2] = x1 - x0;
+        header[3] = y1 - y0;
+    }
+    int width = header[2];
+    int height = header[3];
+    memcpy(tile, header, sizeof(header));
+    memset(scratch, 0, (size_t)width * height * sizeof(float));
+
+    // Add each coordinates contribution to texel centers within reach
+    int start_x, end_x, start_y, end_y;
+    float dx, dy, r_squared;
+    for(i=0; i<num_coords && width; i+=2) {
+        x = coord_to_texel(coords[i], field_width);
+        y = coord_to_texel(coords[i+1], field_height);
+        start_x = (int)ceilf(x - reach - 0.5f);
+        end_x = (int)floorf(x + reach - 0.5f);
+        start_y = (int)ceilf(y - reach - 0.5f);
+        end_y = (int)floorf(y + reach - 0.5f);
+        if(start_x < x0) start_x = x0;
+        if(start_y < y0) start_y = y0;
+        if(end_x >= x1) end_x = x1 - 1;
+        if(end_y >= y1) end_y = y1 - 1;
+        for(ty=start_y; ty<=end_y; ty++) {
+            dy = ty + 0.5f - y;
+            for(tx=start_x; tx<=end_x; tx++) {
+                dx = tx + 0.5f - x;
+                r_squared = (dx*dx + dy*dy) * inv_radius_squared;
+                if(r_squared <= FRAME_FIELD_CUTOFF)
+                    scratch[(ty-y0)*width + (tx-x0)] += 1.0f - 3.0f*r_squared;
+            }
+        }
+    }
+
+    // Quantize to bytes as the additive blend into an 8 bit texture would
+    unsigned char *texels = tile + sizeof(header);
+    int value;
+    for(i=0; i<width*height; i++) {
+        value = (int)(scratch[i]*255.0f + 0.5f);
+        texels[i] = value > 255 ? 255 : value;
+    }
+
+    return FRAME_FIELD_BYTES(width, height);
+}
+
+// Add a density tile into the alpha channel of an RGBA field, saturating at 255
+void add_frame_field(const unsigned char *tile, const float *field_dims, unsigned char *field)
+{
+    int header[FRAME_FIELD_HEADER];
+    memcpy(header, tile, sizeof(header));
+    const unsigned char *texels = tile + sizeof(header);
+
+    int field_width = (int)field_dims[0];
+    int tx, ty, sum;
+    unsigned char *alpha;
+    for(ty=0; ty<header[3]; ty++) {
+        alpha = field + 4*((size_t)(header[1]+ty)*field_width + header[0]) + 3;
+        for(tx=0; tx<header[2]; tx++, alpha+=4) {
+            sum = *alpha + *texels++;
+            *alpha = sum > 255 ? 255 : sum;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef fluid_frame_stream_h
+#define fluid_frame_stream_h
+
+// Frame formats, compute ranks and the render node use the lowest format any of them supports
+#define FRAME_FORMAT_RAW 0    // Coordinates as shorts
+#define FRAME_FORMAT_PACKED 1 // Coordinates sorted by cell, delta encoded, and bit packed
+#define FRAME_FORMAT_LATEST FRAME_FORMAT_PACKED
+
+// OpenGL coordinate sent as SHRT_MAX, coordinates cover the view plus a margin so particles straddling its edge stay visible
+#define FRAME_COORD_SCALE 1.05f
+
+// Coordinates are binned into 2^FRAME_CELL_BITS cells along each axis
+#define FRAME_CELL_BITS 3
+// Low bits of each coordinate that are not sent, 4 leaves 4096 positions across the screen
+#define FRAME_DROP_BITS 4
+
+// Scratch space needed to pack num_coords coordinates
+#define FRAME_PACK_SCRATCH(num_coords) ((num_coords) * sizeof(unsigned short))
+
+// Liquid density field tiles, a header of FRAME_FIELD_HEADER ints {x, y, width, height} followed by one byte per texel
+// Texel intensities match the liquid point splat, 1-3r^2 for r^2 <= FRAME_FIELD_CUTOFF, summed and saturated at 255
+#define FRAME_FIELD_HEADER 4
+#define FRAME_FIELD_CUTOFF 0.34f
+#define FRAME_FIELD_BYTES(width, height) (FRAME_FIELD_HEADER * sizeof(int) + (size_t)(width) * (height))
+
+int pack_frame(const short *coords, int num_coords, unsigned char *packed, unsigned short *scratch);
+void unpack_frame(const unsigned char *packed, int num_coords, short *coords);
+int splat_frame_field(const short *coords, int num_coords, const float *field_dims, float *scratch, unsigned char *tile);
+void add_frame_field(const unsigned char *tile, const float *field_dims, unsigned char *field);
+
+#endif
@@ -25,32 +25,36 @@ THE SOFTWARE.
 #include <stdio.h>
 #include "geometry.h"
 #include "fluid.h"
+#include "scene.h"
 
-void constructFluidVolume(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, AABB_t *fluid, int start_x, 
-			  int number_particles_x, edge_t *edges, float spacing, param *params)
+// Place this ranks fluid particles on the lattice columns of its partition
+void constructFluidVolume(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, scene_t *scene,
+                          AABB_t *boundary_global, int column_start, int number_columns, int max_fluid_particles_local, param *params)
 {
-    int num_y;
-    
-    // Number of particles in y,z, number in x is passed in
-    num_y = floor((fluid->max_y - fluid->min_y ) / spacing);
-    
-    // zero out number of edge particles
-    edges->number_edge_particles_left = 0;
-    edges->number_edge_particles_right = 0;
-    
-    // Place particles inside bounding volume
+    float spacing = scene->spacing;
+    int num_y = ceil((boundary_global->max_y - boundary_global->min_y) / spacing);
+
+    // Place particles inside fluid volumes
     float x,y;
     int nx,ny;
     int i = 0;
     fluid_particle *p;
-    for(ny=0; ny<num_y; ny++) {
-        y = fluid->min_y + ny*spacing;
-        for(nx=0; nx<number_particles_x; nx++) {
-            x = fluid->min_x + (start_x + nx)*spacing;
+    for(nx=column_start; nx<column_start+number_columns; nx++) {
+        x = boundary_global->min_x + nx*spacing;
+        for(ny=0; ny<num_y; ny++) {
+            y = boundary_global->min_y + ny*spacing;
+            if(!scene_fluid(scene, x, y))
+                continue;
+
+            if(i == max_fluid_particles_local) {
+                printf("Scene needs more than %d particles on a rank, raise its capacity\n", max_fluid_particles_local);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+
             p = fluid_particles + i;
             p->x = x;
             p->y = y;
-            
+
             // Set pointer array
             fluid_particle_pointers[i] = p;
 	    fluid_particle_pointers[i]->id = i;
@@ -58,9 +62,7 @@ void constructFluidVolume(fluid_particle **fluid_particle_pointers, fluid_partic
         }
     }
 
-    int rank;
-    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
-    printf("rank %d max fluid x: %f\n", rank,fluid->min_x + (start_x + nx-1)*spacing);
+    printf("initial number of particles %d\n", i);
 
     params->number_fluid_particles_local = i;
     params->max_fluid_particle_index = i - 1;
@@ -68,95 +70,91 @@ void constructFluidVolume(fluid_particle **fluid_particle_pointers, fluid_partic
 
 // Sets upper bound on number of particles, used for memory allocation
 // These numbers are set judiciously for TitanTitan as the number of particles is always small
-void setParticleNumbers(AABB_t *boundary_global, AABB_t *fluid_global, edge_t *edges, oob_t *out_of_bounds, int number_particles_x, float spacing, param *params)
+void setParticleNumbers(edge_t *edges, oob_t *out_of_bounds, param *params)
 {
-    int num_x, num_y, max_y;
-    
-
-    // Set fluid local
-    num_x = number_particles_x;
-    num_y = floor((fluid_global->max_y - fluid_global->min_y ) / spacing);
-    max_y = floor((boundary_global->max_y - boundary_global->min_y ) / spacing);
-
     // Maximum edge(halo) particles
-    edges->max_edge_particles = params->number_fluid_particles_global;
-
-    // The out of bounds particles can become quite large
-    // If a flood of particles flows into and then out of a node
-    // This will be large
-    out_of_bounds->max_oob_particles = params->number_fluid_particles_global;
-
-    // Initial fluid particles
-    int num_initial = num_x * num_y;
-    printf("initial number of particles %d\n", num_initial);
-
-    // Allow space for all particles if neccessary
-    int num_local_max = params->number_fluid_particles_global;
+    edges->max_edge_particles = params->max_fluid_particles_local;
 
     out_of_bounds->number_vacancies = 0;
-    
 }
 
-// Set local boundary and fluid particle
-void partitionProblem(AABB_t *boundary_global, AABB_t *fluid_global, int *x_start, int *length_x, float spacing, param *params)
+// Set local partition and the global number of particles, collective over MPI_COMM_COMPUTE
+// Particles are placed on a lattice whose columns are spaced from the world min x,
+// each active rank is given a run of columns holding about the same number of particles
+void partitionProblem(AABB_t *boundary_global, scene_t *scene, int *column_start, int *number_columns, param *params)
 {
-    int i;
+    int i, j;
     int rank;
     MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
     int nprocs;
     MPI_Comm_size(MPI_COMM_COMPUTE, &nprocs);
 
-    // number of fluid particles in x direction
-    // +1 added for zeroth particle
-    int fluid_particles_x = floor((fluid_global->max_x - fluid_global->min_x ) / spacing) + 1;
-    
-    // number of particles x direction
-    int *particle_length_x = malloc(nprocs*sizeof(int));
-    
-    // Number of particles in x direction assuming equal spacing
-    int equal_spacing = floor(fluid_particles_x/nprocs);
-    
-    // Initialize each node to have equal width
-    for (i=0; i<nprocs; i++)
-        particle_length_x[i] = equal_spacing;
-    
-    // Remaining particles from equal division
-    int remaining = fluid_particles_x - (equal_spacing * nprocs);
-    
-    // Add any remaining particles sequantially to left most nodes
-    for (i=0; i<nprocs; i++)
-        particle_length_x[i] += (i<remaining?1:0);
-    
-    // Number of particles to left of current node
+    // Spare ranks start inactive with no particles, outside of the simulation like removed ranks
+    int nprocs_active = INITIAL_ACTIVE_PROCS(nprocs);
+    params->tunable_params.active = rank < nprocs_active;
+
+    // Lattice columns, +1 added for zeroth column, and rows
+    float spacing = scene->spacing;
+    int num_x = floor((boundary_global->max_x - boundary_global->min_x) / spacing) + 1;
+    int num_y = ceil((boundary_global->max_y - boundary_global->min_y) / spacing);
+
+    // Each compute rank counts the fluid particles of an equal slice of the columns
+    int *column_counts = calloc(num_x, sizeof(int));
+    float x, y;
+    for(i=rank*num_x/nprocs; i<(rank+1)*num_x/nprocs; i++) {
+        x = boundary_global->min_x + i*spacing;
+        for(j=0; j<num_y; j++) {
+            y = boundary_global->min_y + j*spacing;
+            if(scene_fluid(scene, x, y))
+                column_counts[i]++;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, column_counts, num_x, MPI_INT, MPI_SUM, MPI_COMM_COMPUTE);
+
+    int total = 0;
+    for(i=0; i<num_x; i++)
+        total += column_counts[i];
+
+    // Prefix sum over the columns, a column belongs to the active rank whose equal share its first particle falls in
     int number_to_left = 0;
-    for (i=0; i<rank; i++)
-        number_to_left+=particle_length_x[i];
-       
-    // starting position of nodes x particles
-    *x_start = number_to_left;
-    // Number of particles in x direction for node
-    *length_x = particle_length_x[rank];
-        
-    // Set node partition values
-    params->tunable_params.node_start_x = fluid_global->min_x + ((number_to_left-1) * spacing);
-    params->tunable_params.node_end_x   = params->tunable_params.node_start_x + (particle_length_x[rank] * spacing);
-    
+    int owner;
+    int start = num_x;
+    int end = num_x;
+    for(i=0; i<num_x; i++) {
+        owner = total ? (int)((long)number_to_left * nprocs_active / total) : 0;
+        if(owner >= rank && start == num_x)
+            start = i;
+        if(owner > rank) {
+            end = i;
+            break;
+        }
+        number_to_left += column_counts[i];
+    }
+
+    *column_start = start;
+    *number_columns = end - start;
+
+    // Partition edges lie halfway between columns
+    params->tunable_params.node_start_x = boundary_global->min_x + (start - 0.5f) * spacing;
+    params->tunable_params.node_end_x   = boundary_global->min_x + (end - 0.5f) * spacing;
+
     if (rank == 0)
         params->tunable_params.node_start_x  = boundary_global->min_x;
-    if (rank == nprocs-1)
+    if (rank == nprocs_active-1)
         params->tunable_params.node_end_x   = boundary_global->max_x;
 
-    printf("Rank %d start_x: %f, end_x :%f\n", rank, params->tunable_params.node_start_x, params->tunable_params.node_end_x);
+    // +1.0 ensures spare partitions are out of the simulation bounds
+    if (rank >= nprocs_active) {
+        params->tunable_params.node_start_x = boundary_global->max_x + 1.0f;
+        params->tunable_params.node_end_x = params->tunable_params.node_start_x;
+    }
 
-    // Update requested number of particles with actual value used
-    int num_y = floor((fluid_global->max_y - fluid_global->min_y ) / spacing);
-    int total_x = 0;
-    for(i=0; i<nprocs; i++)
-        total_x += particle_length_x[i];
-    params->number_fluid_particles_global = total_x * num_y;
+    printf("Rank %d start_x: %f, end_x :%f\n", rank, params->tunable_params.node_start_x, params->tunable_params.node_end_x);
 
-    free(particle_length_x);
+    // Exact number of particles the scene creates
+    params->number_fluid_particles_global = total;
 
+    free(column_counts);
 }
 
 ////////////////////////////////////////////////
@@ -26,6 +26,7 @@ THE SOFTWARE.
 #define fluid_geometry_h
 
 typedef struct AABB_T AABB_t;
+typedef struct SCENE_T scene_t;
 
 #include "fluid.h"
 #include "communication.h"
@@ -42,10 +43,10 @@ struct AABB_T {
 float min(float a, float b);
 float max(float a, float b);
 int sgn(float x);
-void partitionProblem(AABB_t *boundary_global, AABB_t *fluid_global, int *x_start, int *length_x, float spacing, param *params);
-void setParticleNumbers(AABB_t *boundary_global, AABB_t *fluid_global, edge_t *edges, oob_t *out_of_bounds, int number_particles_x, float spacing, param *params);
+void partitionProblem(AABB_t *boundary_global, scene_t *scene, int *column_start, int *number_columns, param *params);
+void setParticleNumbers(edge_t *edges, oob_t *out_of_bounds, param *params);
 
-void constructFluidVolume(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, AABB_t* fluid, int start_x, 
-                          int number_particles_x, edge_t *edges, float spacing, param *params);
+void constructFluidVolume(fluid_particle **fluid_particle_pointers, fluid_particle *fluid_particles, scene_t *scene,
+                          AABB_t *boundary_global, int column_start, int number_columns, int max_fluid_particles_local, param *params);
 
 #endif
@@ -108,6 +108,33 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
             case GLFW_KEY_L:
                 toggle_liquid(render_state);
                 break;
+            case GLFW_KEY_K:
+                toggle_blur(render_state);
+                break;
+            case GLFW_KEY_EQUAL:
+            case GLFW_KEY_KP_ADD:
+                zoom_in(render_state);
+                break;
+            case GLFW_KEY_MINUS:
+            case GLFW_KEY_KP_SUBTRACT:
+                zoom_out(render_state);
+                break;
+            case GLFW_KEY_KP_4:
+                pan_left(render_state);
+                break;
+            case GLFW_KEY_KP_6:
+                pan_right(render_state);
+                break;
+            case GLFW_KEY_KP_8:
+                pan_up(render_state);
+                break;
+            case GLFW_KEY_KP_2:
+                pan_down(render_state);
+                break;
+            case GLFW_KEY_0:
+            case GLFW_KEY_KP_0:
+                reset_view(render_state);
+                break;
         }
     }
 }
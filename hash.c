@@ -240,3 +240,61 @@ void hash_fluid(fluid_particle **fluid_particle_pointers, neighbor_grid_t *grid,
         } // end grid x
 
 }// end function
+
+// Add the fluid particles from first on, such as those just received, to a grid already filled by hash_fluid
+// Each is given the particles within h that are already hashed as neighbors, so every pair is still listed once
+void hash_arrivals(fluid_particle **fluid_particle_pointers, neighbor_grid_t *grid, param *params, int first)
+{
+    int i,dx,dy,grid_x,grid_y;
+    unsigned int n,index;
+    float r2;
+    fluid_particle *p, *q;
+    neighbor *ne;
+
+    float h = params->tunable_params.smoothing_radius;
+    float h2 = h*h;
+    float spacing = grid->spacing;
+    int max_neighbors = grid->max_neighbors;
+    unsigned int max_bucket_size = grid->max_bucket_size;
+    neighbor *neighbors = grid->neighbors;
+    bucket_t *grid_buckets = grid->grid_buckets;
+
+    for(i=first; i<params->number_fluid_particles_local; i++) {
+        p = fluid_particle_pointers[i];
+        ne = &neighbors[p->id];
+        ne->number_fluid_neighbors = 0;
+
+        grid_x = floor(p->x/spacing);
+        grid_y = floor(p->y/spacing);
+
+        // Check the particles bucket and all around it
+        for (dx=-1; dx<=1; dx++) {
+            for (dy=-1; dy<=1; dy++) {
+                if ( grid_y+dy < 0 || grid_x+dx < 0 || (unsigned int)(grid_x+dx) >= grid->size_x || (unsigned int)(grid_y+dy) >= grid->size_y)
+                    continue;
+
+                index = (grid_y + dy)*grid->size_x + (grid_x + dx);
+                for (n=0; n<grid_buckets[index].number_fluid; n++) {
+                    q = grid_buckets[index].fluid_particles[n];
+                    r2 = (p->x-q->x)*(p->x-q->x) + (p->y-q->y)*(p->y-q->y);
+                    if(r2 > h2)
+                        continue;
+
+                    if(ne->number_fluid_neighbors < max_neighbors)
+                        ne->fluid_neighbors[ne->number_fluid_neighbors++] = q;
+                    else
+                        debug_print("arrival overflow\n");
+                }
+            }
+        }
+
+        // Later arrivals will find this one
+        index = hash_val(p->x, p->y, grid, params);
+        if (grid_buckets[index].number_fluid < max_bucket_size) {
+            grid_buckets[index].fluid_particles[grid_buckets[index].number_fluid] = p;
+            grid_buckets[index].number_fluid++;
+        }
+        else
+            debug_print("arrival bucket overflow\n");
+    }
+}
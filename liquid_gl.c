@@ -39,6 +39,8 @@ void init_liquid(liquid_t *state, int screen_width, int screen_height)
 {
     state->screen_width = screen_width;
     state->screen_height = screen_height;
+    state->coord_scale = 1.0f;
+    state->dual_blur = false;
 
     // Amount fluid texture will be reduced from screen resolution
     #ifdef RASPI
@@ -47,6 +49,9 @@ void init_liquid(liquid_t *state, int screen_width, int screen_height)
     state->reduction = 2;
     #endif
 
+    // Two texels, a whole number keeps the dual filter's downsample taps on texel corners
+    state->dual_spread = 4.0f;
+
     // Create circle buffers
     create_liquid_buffers(state);
 
@@ -59,23 +64,40 @@ void init_liquid(liquid_t *state, int screen_width, int screen_height)
 }
 
 // Update coordinate of fluid points
-void render_liquid(float *points, float diameter_pixels, int num_points, liquid_t *state)
+void render_liquid(short **rank_coords, int *coord_counts, int num_ranks, float diameter_pixels, liquid_t *state)
 {
-    // Set buffer
-    glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+    state->vbo = buffer_rank_coords(&state->ring, rank_coords, coord_counts, num_ranks);
 
-    // Orphan current buffer
-    glBufferData(GL_ARRAY_BUFFER, 2*num_points*sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+    // Hack for reduced texture size, the dual filter splats at half that again
+    float hack_diameter = diameter_pixels/(float)state->reduction;
+    if(state->dual_blur)
+        hack_diameter *= 0.5f;
+    draw_liquid(state, hack_diameter, coord_counts, num_ranks);
 
-    // Fill buffer
-    glBufferData(GL_ARRAY_BUFFER, 2*num_points*sizeof(GLfloat), points, GL_STREAM_DRAW);
+    release_vertex_ring(&state->ring);
+}
 
-    // Unbind buffer
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+// Render liquid from an RGBA density field the size of the low resolution texture
+// The field replaces the point splat, only its alpha channel is used
+void render_liquid_field(unsigned char *field, liquid_t *state)
+{
+    // Upload field into the texture points would be splatted into
+    glBindTexture(GL_TEXTURE_2D, state->tex_uniform);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, state->screen_width/state->reduction, state->screen_height/state->reduction, GL_RGBA, GL_UNSIGNED_BYTE, field);
 
-    // Hack for reduced texture size
-    float hack_diameter = diameter_pixels/(float)state->reduction;
-    draw_liquid(state, hack_diameter, num_points);
+    // Field is already at the low resolution, the dual filter downsamples it from there
+    if(state->dual_blur) {
+        dual_blur_liquid(state, state->tex_uniform, state->screen_width/state->reduction, state->screen_height/state->reduction);
+        return;
+    }
+
+    // Bind frame buffer for render to texture
+    glBindFramebuffer(GL_FRAMEBUFFER, state->frame_buffer_two);
+
+    // Set viewport for low resolution texture
+    glViewport(0,0,state->screen_width/state->reduction, state->screen_height/state->reduction);
+
+    blur_liquid(state);
 }
 
 void create_liquid_buffers(liquid_t *state)
@@ -88,7 +110,7 @@ void create_liquid_buffers(liquid_t *state)
     #endif
 
     // Generate vertex buffer
-    glGenBuffers(1, &state->vbo);
+    init_vertex_ring(&state->ring);
     glGenBuffers(1, &state->tex_vbo);
     // Generate element buffer
     glGenBuffers(1, &state->tex_ebo);
@@ -138,6 +160,27 @@ void create_liquid_buffers(liquid_t *state)
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, state->blur_horz_tex_uniform, 0);
     #endif
 
+    // Dual filter blur textures, each half the size of the one before
+    // Particles are splatted into the first and downsampled into the second
+    glGenFramebuffers(2, state->dual_frame_buffers);
+    glGenTextures(2, state->dual_tex_uniforms);
+    int i;
+    for(i=0; i<2; i++) {
+        state->dual_widths[i] = state->screen_width/(state->reduction*(2<<i));
+        state->dual_heights[i] = state->screen_height/(state->reduction*(2<<i));
+
+        glBindFramebuffer(GL_FRAMEBUFFER, state->dual_frame_buffers[i]);
+        glBindTexture(GL_TEXTURE_2D, state->dual_tex_uniforms[i]);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, state->dual_widths[i], state->dual_heights[i], 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, state->dual_tex_uniforms[i], 0);
+    }
+
     // Reset frame buffer and texture
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -266,10 +309,54 @@ void create_liquid_shaders(liquid_t *state)
     glLinkProgram(state->horz_blur_program);
     show_program_log(state->horz_blur_program);
 
+    // Compile dual filter vertex shader, shared with the texture program
+    vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    #ifdef RASPI
+      compile_shader(vertexShader, "SPH/shaders/render_liquid_texture_es.vert");
+    #else
+      compile_shader(vertexShader, "shaders/render_liquid_texture.vert");
+    #endif
+
+    // Compile dual filter downsample frag shader
+    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    #ifdef RASPI
+      compile_shader(fragmentShader, "SPH/shaders/dual_down_es.frag");
+    #else
+      compile_shader(fragmentShader, "shaders/dual_down.frag");
+    #endif
+
+    // Create dual filter downsample program
+    state->dual_down_program = glCreateProgram();
+    glAttachShader(state->dual_down_program, vertexShader);
+    glAttachShader(state->dual_down_program, fragmentShader);
+
+    // Link and use program
+    glLinkProgram(state->dual_down_program);
+    show_program_log(state->dual_down_program);
+
+    // Compile dual filter upsample frag shader
+    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    #ifdef RASPI
+      compile_shader(fragmentShader, "SPH/shaders/dual_up_es.frag");
+    #else
+      compile_shader(fragmentShader, "shaders/dual_up.frag");
+    #endif
+
+    // Create dual filter upsample program
+    state->dual_up_program = glCreateProgram();
+    glAttachShader(state->dual_up_program, vertexShader);
+    glAttachShader(state->dual_up_program, fragmentShader);
+
+    // Link and use program
+    glLinkProgram(state->dual_up_program);
+    show_program_log(state->dual_up_program);
+
     // Get position location
     state->position_location = glGetAttribLocation(state->program, "position");
     // Get pixel diameter location
     state->diameter_pixels_location = glGetUniformLocation(state->program, "diameter_pixels");
+    // Get coordinate scale location
+    state->coord_scale_location = glGetUniformLocation(state->program, "coord_scale");
 
     // Get position location
     state->tex_position_location = glGetAttribLocation(state->tex_program, "position");
@@ -292,6 +379,18 @@ void create_liquid_shaders(liquid_t *state)
     // Get tex uniform location
     state->horz_blur_tex_location = glGetUniformLocation(state->horz_blur_program, "tex");
 
+    // Get dual filter downsample locations
+    state->dual_down_position_location = glGetAttribLocation(state->dual_down_program, "position");
+    state->dual_down_tex_coord_location = glGetAttribLocation(state->dual_down_program, "tex_coord");
+    state->dual_down_tex_location = glGetUniformLocation(state->dual_down_program, "tex");
+    state->dual_down_spread_location = glGetUniformLocation(state->dual_down_program, "spread");
+
+    // Get dual filter upsample locations
+    state->dual_up_position_location = glGetAttribLocation(state->dual_up_program, "position");
+    state->dual_up_tex_coord_location = glGetAttribLocation(state->dual_up_program, "tex_coord");
+    state->dual_up_tex_location = glGetUniformLocation(state->dual_up_program, "tex");
+    state->dual_up_spread_location = glGetUniformLocation(state->dual_up_program, "spread");
+
     // Enable point size to be specified in the shader
     #ifndef RASPI
     glEnable(GL_PROGRAM_POINT_SIZE);
@@ -302,8 +401,10 @@ void create_liquid_shaders(liquid_t *state)
 //   printf("min: %f, max: %f\n", fSizes[0], fSizes[1]);
 }
 
-void draw_liquid(liquid_t *state, float diameter_pixels, int num_points)
+void draw_liquid(liquid_t *state, float diameter_pixels, int *coord_counts, int num_ranks)
 {
+    int i;
+
     //////
     // First phase - draw gaussian balls at particle position
     /////
@@ -314,10 +415,14 @@ void draw_liquid(liquid_t *state, float diameter_pixels, int num_points)
     // Set pixel diameter uniform
     glUniform1f(state->diameter_pixels_location, (GLfloat)diameter_pixels);
 
+    // Set coordinate scale uniform
+    glUniform1f(state->coord_scale_location, (GLfloat)state->coord_scale);
+
     // Set buffer
     glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
 
-    glVertexAttribPointer(state->position_location, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GL_FLOAT), 0);
+    // Shorts are normalized to [-1,1]
+    glVertexAttribPointer(state->position_location, 2, GL_SHORT, GL_TRUE, 2*sizeof(GLshort), 0);
     glEnableVertexAttribArray(state->position_location);
 
     // Blend is required to show cleared color when the frag shader draws transparent pixels
@@ -325,11 +430,15 @@ void draw_liquid(liquid_t *state, float diameter_pixels, int num_points)
     glEnable(GL_BLEND);
     glBlendFunc(GL_ONE, GL_ONE);
 
-    // Bind frame buffer for render to texture
-    glBindFramebuffer(GL_FRAMEBUFFER, state->frame_buffer_two);
-
-    // Set viewport for low resolution texture
-    glViewport(0,0,state->screen_width/state->reduction, state->screen_height/state->reduction);
+    // Bind frame buffer for render to texture, the dual filter splats at half the low resolution
+    if(state->dual_blur) {
+        glBindFramebuffer(GL_FRAMEBUFFER, state->dual_frame_buffers[0]);
+        glViewport(0,0,state->dual_widths[0], state->dual_heights[0]);
+    }
+    else {
+        glBindFramebuffer(GL_FRAMEBUFFER, state->frame_buffer_two);
+        glViewport(0,0,state->screen_width/state->reduction, state->screen_height/state->reduction);
+    }
 
     #ifndef RASPI
     // Set color attachment to draw into
@@ -341,9 +450,22 @@ void draw_liquid(liquid_t *state, float diameter_pixels, int num_points)
     // Clear background
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // Draw to color attachment 0 texture
-    glDrawArrays(GL_POINTS, 0, num_points);
+    // Draw to color attachment 0 texture, ranks coordinates needn't be contiguous
+    for(i=0; i<num_ranks; i++) {
+        if(coord_counts[i])
+            glDrawArrays(GL_POINTS, state->ring.firsts[i], coord_counts[i]/2);
+    }
 
+    if(state->dual_blur)
+        dual_blur_liquid(state, state->dual_tex_uniforms[0], state->dual_widths[0], state->dual_heights[0]);
+    else
+        blur_liquid(state);
+}
+
+// Blur the low resolution texture and draw it to the screen
+// Expects frame_buffer_two and the low resolution viewport to be bound
+void blur_liquid(liquid_t *state)
+{
     //////
     // Second phase - horizontal blur
     /////
@@ -445,3 +567,75 @@ void draw_liquid(liquid_t *state, float diameter_pixels, int num_points)
     // Draw texture to screen
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
 }
+
+// Blur source_tex with a dual filter and draw it to the screen
+// A downsample and an upsample pass of a few bilinear taps stand in for the two 15 tap Gaussian passes,
+// the upsample is drawn at screen resolution and shades the surface as the composite does
+// Tap offsets are in texels of the texture each pass samples, source_tex is source_width by source_height
+void dual_blur_liquid(liquid_t *state, GLuint source_tex, int source_width, int source_height)
+{
+    float half_spread = 0.5f*state->dual_spread;
+
+    //////
+    // First phase - downsample into the quarter resolution texture
+    /////
+    glUseProgram(state->dual_down_program);
+
+    // Setup buffers
+    size_t vert_size = 4*sizeof(GL_FLOAT);
+    glBindBuffer(GL_ARRAY_BUFFER, state->tex_vbo);
+    glVertexAttribPointer(state->dual_down_position_location, 2, GL_FLOAT, GL_FALSE, vert_size, 0);
+    glEnableVertexAttribArray(state->dual_down_position_location);
+    glVertexAttribPointer(state->dual_down_tex_coord_location, 2, GL_FLOAT, GL_FALSE, vert_size,(void*)(2*sizeof(GL_FLOAT)));
+    glEnableVertexAttribArray(state->dual_down_tex_coord_location);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, state->tex_ebo);
+
+    // Every texel is written so no blending or clear is needed
+    glDisable(GL_BLEND);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, state->dual_frame_buffers[1]);
+    glViewport(0,0,state->dual_widths[1], state->dual_heights[1]);
+
+    #ifndef RASPI
+    // Set color attachment to draw into
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    #endif
+
+    // Setup texture to read from
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source_tex);
+    glUniform1i(state->dual_down_tex_location, 0);
+    glUniform2f(state->dual_down_spread_location, half_spread/source_width, half_spread/source_height);
+
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
+
+    //////
+    // Second phase - upsample to the screen and draw the fluid surface
+    /////
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glUseProgram(state->dual_up_program);
+
+    // Attributes must be pointed at for this program's locations
+    glBindBuffer(GL_ARRAY_BUFFER, state->tex_vbo);
+    glVertexAttribPointer(state->dual_up_position_location, 2, GL_FLOAT, GL_FALSE, vert_size, 0);
+    glEnableVertexAttribArray(state->dual_up_position_location);
+    glVertexAttribPointer(state->dual_up_tex_coord_location, 2, GL_FLOAT, GL_FALSE, vert_size,(void*)(2*sizeof(GL_FLOAT)));
+    glEnableVertexAttribArray(state->dual_up_tex_coord_location);
+
+    // Set viewport back to "normal"
+    glViewport(0,0,state->screen_width, state->screen_height);
+
+    // Setup texture
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, state->dual_tex_uniforms[1]);
+    glUniform1i(state->dual_up_tex_location, 0);
+    glUniform2f(state->dual_up_spread_location, half_spread/state->dual_widths[1], half_spread/state->dual_heights[1]);
+
+    // Enable "standard" blending
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Draw texture to screen
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, 0);
+}
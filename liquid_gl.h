@@ -32,6 +32,8 @@ THE SOFTWARE.
     #include "egl_utils.h"
 #endif
 
+#include "ogl_utils.h"
+
 typedef struct liquid_t {
     // Program handle
     GLuint program;
@@ -45,9 +47,17 @@ typedef struct liquid_t {
     // Program for horizontal Gaussian blur
     GLuint horz_blur_program;
 
+    // Programs for the dual filter blur, the upsample also draws the surface
+    GLuint dual_down_program;
+    GLuint dual_up_program;
+
     // Render to low rez tex Locations
     GLint position_location;
     GLint diameter_pixels_location;
+    GLint coord_scale_location;
+
+    // Received coordinates are scaled by this after normalizing
+    float coord_scale;
 
     // Gaussian locations
     GLint vert_blur_position_location;
@@ -57,6 +67,16 @@ typedef struct liquid_t {
     GLint horz_blur_tex_coord_location;
     GLint horz_blur_tex_location;
 
+    // Dual filter locations
+    GLint dual_down_position_location;
+    GLint dual_down_tex_coord_location;
+    GLint dual_down_tex_location;
+    GLint dual_down_spread_location;
+    GLint dual_up_position_location;
+    GLint dual_up_tex_coord_location;
+    GLint dual_up_tex_location;
+    GLint dual_up_spread_location;
+
     // Render tex to quad Locations
     GLint tex_position_location;
     GLint tex_location;
@@ -71,7 +91,8 @@ typedef struct liquid_t {
     int screen_height;
 
     // buffers
-    GLuint vbo;
+    vertex_ring_t ring;
+    GLuint vbo; // Buffer of the ring drawn from
     GLuint tex_vbo;
     GLuint tex_ebo;
 
@@ -86,13 +107,26 @@ typedef struct liquid_t {
     GLuint tex_color_buffer;
     GLuint blur_horz_color_buffer;
 
+    // Dual filter blur splats at half the low resolution and downsamples to a quarter of it
+    GLuint dual_frame_buffers[2];
+    GLuint dual_tex_uniforms[2];
+    int dual_widths[2];
+    int dual_heights[2];
+
+    // Blur with the dual filter instead of the separable Gaussian
+    bool dual_blur;
+    float dual_spread; // Dual filter tap offset in half texels of the texture each pass samples
+
     GLuint reduction;
 } liquid_t;
 
 void init_liquid(liquid_t *state, int screen_width, int screen_height);
-void render_liquid(float *points, float diameter_pixels, int num_points, liquid_t *state);
+void render_liquid(short **rank_coords, int *coord_counts, int num_ranks, float diameter_pixels, liquid_t *state);
+void render_liquid_field(unsigned char *field, liquid_t *state);
 void create_liquid_shaders(liquid_t *state);
-void draw_liquid(liquid_t *state, float diameter_pixels, int num_points);
+void draw_liquid(liquid_t *state, float diameter_pixels, int *coord_counts, int num_ranks);
+void blur_liquid(liquid_t *state);
+void dual_blur_liquid(liquid_t *state, GLuint source_tex, int source_width, int source_height);
 void create_liquid_buffers(liquid_t *state);
 void create_texture_verticies(liquid_t *state);
 
@@ -26,6 +26,7 @@ THE SOFTWARE.
 #include <assert.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ogl_utils.h"
 
 inline void check()
@@ -75,3 +76,216 @@ void compile_shader(GLuint shader, const char *file_name)
 
     free(shader_source);
 }
+
+void init_vertex_ring(vertex_ring_t *ring)
+{
+    glGenBuffers(VERTEX_RING_SIZE, ring->vbos);
+    ring->current = 0;
+    ring->capacity = 0;
+
+    #ifdef GLFW
+    int i;
+    ring->persistent = GLEW_ARB_buffer_storage;
+    for(i=0; i<VERTEX_RING_SIZE; i++) {
+        ring->mapped[i] = NULL;
+        ring->fences[i] = NULL;
+    }
+    #else
+    ring->persistent = false;
+    #endif
+
+    ring->frames = NULL;
+    ring->in_frames = false;
+    ring->frames_half = 0;
+    ring->firsts = NULL;
+    ring->max_ranks = 0;
+}
+
+// Make room for bytes in every buffer of the ring
+// Persistent storage is immutable so the buffers are replaced once the GPU is done with them
+static void grow_vertex_ring(vertex_ring_t *ring, GLsizeiptr bytes)
+{
+    int i;
+
+    // Leave room to grow so a frame slightly larger than the last doesn't reallocate
+    ring->capacity = bytes + bytes/2;
+
+    #ifdef GLFW
+    if(ring->persistent) {
+        for(i=0; i<VERTEX_RING_SIZE; i++) {
+            if(ring->fences[i]) {
+                glClientWaitSync(ring->fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(ring->fences[i]);
+                ring->fences[i] = NULL;
+            }
+        }
+        glDeleteBuffers(VERTEX_RING_SIZE, ring->vbos);
+        glGenBuffers(VERTEX_RING_SIZE, ring->vbos);
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        for(i=0; i<VERTEX_RING_SIZE; i++) {
+            glBindBuffer(GL_ARRAY_BUFFER, ring->vbos[i]);
+            glBufferStorage(GL_ARRAY_BUFFER, ring->capacity, NULL, flags);
+            ring->mapped[i] = glMapBufferRange(GL_ARRAY_BUFFER, 0, ring->capacity, flags);
+            if(!ring->mapped[i])
+                break;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if(i == VERTEX_RING_SIZE)
+            return;
+
+        // Storage that can't be mapped is immutable, so it's replaced by buffers that are uploaded into each frame
+        printf("Failed to map vertex ring buffer, falling back to uploading frames\n");
+        ring->persistent = false;
+        for(i=0; i<VERTEX_RING_SIZE; i++)
+            ring->mapped[i] = NULL;
+        glDeleteBuffers(VERTEX_RING_SIZE, ring->vbos);
+        glGenBuffers(VERTEX_RING_SIZE, ring->vbos);
+    }
+    #endif
+
+    for(i=0; i<VERTEX_RING_SIZE; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, ring->vbos[i]);
+        glBufferData(GL_ARRAY_BUFFER, ring->capacity, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Copy each ranks (x,y) short coordinates back to back into the next buffer of the ring
+// If they were all received into the ring's frames buffer they are drawn from there without a copy
+// The coordinates are used as received, the vertex shader normalizes them
+// Returns the buffer to draw from with the first point of each rank in ring->firsts,
+// release_vertex_ring must be called once the draws using it are issued
+GLuint buffer_rank_coords(vertex_ring_t *ring, short **rank_coords, int *coord_counts, int num_ranks)
+{
+    int i;
+    int num_coords = 0;
+
+    if(num_ranks > ring->max_ranks) {
+        ring->firsts = realloc(ring->firsts, num_ranks * sizeof(int));
+        ring->max_ranks = num_ranks;
+    }
+    int *firsts = ring->firsts;
+
+    // Packed frames are unpacked outside of the frames buffer and must be copied
+    ring->in_frames = ring->frames != NULL;
+    for(i=0; i<num_ranks && ring->in_frames; i++) {
+        char *coords = (char*)rank_coords[i];
+        ring->in_frames = coords >= ring->frames->mapped && coords + coord_counts[i]*sizeof(GLshort) <= ring->frames->mapped + ring->frames->size
+                          && (coords - ring->frames->mapped) % (2*sizeof(GLshort)) == 0;
+    }
+    if(ring->in_frames) {
+        for(i=0; i<num_ranks; i++)
+            firsts[i] = ((char*)rank_coords[i] - ring->frames->mapped) / (2*sizeof(GLshort));
+        ring->frames_half = num_ranks ? ((char*)rank_coords[0] - ring->frames->mapped) / (ring->frames->size/2) : 0;
+        return ring->frames->vbo;
+    }
+
+    for(i=0; i<num_ranks; i++) {
+        firsts[i] = num_coords/2;
+        num_coords += coord_counts[i];
+    }
+
+    GLsizeiptr bytes = num_coords*sizeof(GLshort);
+    if(bytes > ring->capacity)
+        grow_vertex_ring(ring, bytes);
+
+    GLuint vbo = ring->vbos[ring->current];
+    GLintptr offset = 0;
+
+    #ifdef GLFW
+    if(ring->persistent) {
+        // Wait for the GPU to finish the frame last drawn from this buffer, normally long done
+        if(ring->fences[ring->current]) {
+            glClientWaitSync(ring->fences[ring->current], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(ring->fences[ring->current]);
+            ring->fences[ring->current] = NULL;
+        }
+
+        // Mapping is coherent, no flush is needed
+        char *mapped = ring->mapped[ring->current];
+        for(i=0; i<num_ranks; i++) {
+            memcpy(mapped + offset, rank_coords[i], coord_counts[i]*sizeof(GLshort));
+            offset += coord_counts[i]*sizeof(GLshort);
+        }
+        return vbo;
+    }
+    #endif
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    for(i=0; i<num_ranks; i++) {
+        glBufferSubData(GL_ARRAY_BUFFER, offset, coord_counts[i]*sizeof(GLshort), rank_coords[i]);
+        offset += coord_counts[i]*sizeof(GLshort);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return vbo;
+}
+
+// Fence the draws from the current buffer and move on to the next
+void release_vertex_ring(vertex_ring_t *ring)
+{
+    #ifdef GLFW
+    if(ring->in_frames) {
+        GLsync *fence = &ring->frames->fences[ring->frames_half];
+        if(*fence)
+            glDeleteSync(*fence);
+        *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return;
+    }
+
+    if(ring->persistent)
+        ring->fences[ring->current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    #endif
+
+    ring->current = (ring->current + 1) % VERTEX_RING_SIZE;
+}
+
+// Create a buffer of size bytes mapped for reading and writing for as long as it exists
+// Returns false, leaving the buffer unusable, without ARB_buffer_storage or if it could not be mapped
+bool create_mapped_buffer(mapped_buffer_t *buffer, GLsizeiptr size)
+{
+    buffer->vbo = 0;
+    buffer->mapped = NULL;
+    buffer->size = 0;
+
+    #ifdef GLFW
+    buffer->fences[0] = NULL;
+    buffer->fences[1] = NULL;
+    if(!GLEW_ARB_buffer_storage)
+        return false;
+
+    GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &buffer->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+    glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+    buffer->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if(!buffer->mapped) {
+        glDeleteBuffers(1, &buffer->vbo);
+        buffer->vbo = 0;
+        return false;
+    }
+    buffer->size = size;
+    #else
+    (void)size;
+    #endif
+
+    return buffer->mapped != NULL;
+}
+
+// Block until the GPU is done with draws issued from half of buffer so its memory may be written again
+void wait_mapped_buffer(mapped_buffer_t *buffer, int half)
+{
+    #ifdef GLFW
+    GLsync *fence = &buffer->fences[half];
+    if(*fence) {
+        glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(*fence);
+        *fence = NULL;
+    }
+    #else
+    (void)buffer;
+    (void)half;
+    #endif
+}
@@ -25,15 +25,57 @@ THE SOFTWARE.
 #ifndef OGL_UTILS_H
 #define OGL_UTILS_H
 
+#include <stdbool.h>
+
 #ifdef GLFW
   #include "glfw_utils.h"
 #else
   #include "egl_utils.h"
 #endif
 
+// Number of vertex buffers streamed coordinates rotate through
+// A buffer is only written again once the frames drawn from the others have been queued
+#define VERTEX_RING_SIZE 3
+
+// Persistently mapped buffer frames are received into, coordinates are drawn where they arrive
+// Each half holds one of the two frame window buffers and is fenced on its own
+// Only available with ARB_buffer_storage
+typedef struct mapped_buffer_t {
+    GLuint vbo;
+    char *mapped;
+    GLsizeiptr size;
+    #ifdef GLFW
+    GLsync fences[2]; // Set once draws from each half are issued
+    #endif
+} mapped_buffer_t;
+
+// Ring of vertex buffers for coordinates streamed in every frame
+// With ARB_buffer_storage the buffers are persistently mapped and fenced, frames are copied straight into them
+// Otherwise, as on GLES2, each is written with glBufferSubData and is idle by the time it's reused
+typedef struct vertex_ring_t {
+    GLuint vbos[VERTEX_RING_SIZE];
+    int current;
+    GLsizeiptr capacity; // Bytes of each buffer
+    bool persistent;
+    #ifdef GLFW
+    void *mapped[VERTEX_RING_SIZE];
+    GLsync fences[VERTEX_RING_SIZE];
+    #endif
+    mapped_buffer_t *frames; // Coordinates already in this buffer are drawn in place instead of copied, may be NULL
+    bool in_frames;          // Current frame is drawn from frames
+    int frames_half;         // Half of frames the current frame is drawn from
+    int *firsts;             // First point of each rank in the buffer drawn from
+    int max_ranks;
+} vertex_ring_t;
+
 inline void check();
 void showlog(GLint shader);
 void show_program_log(GLuint program);
 void compile_shader(GLuint shader, const char *file_name);
+void init_vertex_ring(vertex_ring_t *ring);
+GLuint buffer_rank_coords(vertex_ring_t *ring, short **rank_coords, int *coord_counts, int num_ranks);
+void release_vertex_ring(vertex_ring_t *ring);
+bool create_mapped_buffer(mapped_buffer_t *buffer, GLsizeiptr size);
+void wait_mapped_buffer(mapped_buffer_t *buffer, int half);
 
 #endif
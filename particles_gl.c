@@ -39,7 +39,7 @@ void init_particles(particles_t *state, int screen_width, int screen_height)
 {
     state->screen_width = screen_width;
     state->screen_height = screen_height;
-
+    state->coord_scale = 1.0f;
 
     // Create circle buffers
     create_particle_buffers(state);
@@ -49,22 +49,14 @@ void init_particles(particles_t *state, int screen_width, int screen_height)
     create_particle_shaders(state);
 }
 
-// Update coordinate of fluid points
-void render_particles(float *points, float diameter_pixels, int num_points, particles_t *state)
+// Update coordinate of fluid points, each ranks coordinates are drawn in its color
+void render_particles(short **rank_coords, int *coord_counts, float *colors_by_rank, int num_ranks, float diameter_pixels, particles_t *state)
 {
-    // Set buffer
-    glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
-
-    // Orphan current buffer
-    glBufferData(GL_ARRAY_BUFFER, 5*num_points*sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+    state->vbo = buffer_rank_coords(&state->ring, rank_coords, coord_counts, num_ranks);
 
-    // Fill buffer
-    glBufferData(GL_ARRAY_BUFFER, 5*num_points*sizeof(GLfloat), points, GL_STREAM_DRAW);
+    draw_particles(state, diameter_pixels, coord_counts, colors_by_rank, num_ranks);
 
-    // Unbind buffer
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-    draw_particles(state, diameter_pixels, num_points);
+    release_vertex_ring(&state->ring);
 }
 
 void create_particle_buffers(particles_t *state)
@@ -76,8 +68,8 @@ void create_particle_buffers(particles_t *state)
     glBindVertexArray(vao);
     #endif
 
-    // Generate vertex buffer
-    glGenBuffers(1, &state->vbo);
+    // Generate vertex buffers
+    init_vertex_ring(&state->ring);
 }
 
 void create_particle_shaders(particles_t *state)
@@ -109,8 +101,10 @@ void create_particle_shaders(particles_t *state)
 
     // Get position location
     state->position_location = glGetAttribLocation(state->program, "position");
-    // Get tex_coord location
-    state->color_location = glGetAttribLocation(state->program, "color");
+    // Get color location
+    state->color_location = glGetUniformLocation(state->program, "color");
+    // Get coordinate scale location
+    state->coord_scale_location = glGetUniformLocation(state->program, "coord_scale");
     // Get radius location
     state->radius_world_location = glGetUniformLocation(state->program, "radius_world");
     // Get pixel diameter location
@@ -126,8 +120,10 @@ void create_particle_shaders(particles_t *state)
 //   printf("min: %f, max: %f\n", fSizes[0], fSizes[1]);
 }
 
-void draw_particles(particles_t *state, float diameter_pixels, int num_points)
+void draw_particles(particles_t *state, float diameter_pixels, int *coord_counts, float *colors_by_rank, int num_ranks)
 {
+    int i;
+
     // Bind circle shader program
     glUseProgram(state->program);
 
@@ -137,18 +133,25 @@ void draw_particles(particles_t *state, float diameter_pixels, int num_points)
     // Set pixel diameter uniform
     glUniform1f(state->diameter_pixels_location, (GLfloat)diameter_pixels);
 
+    // Set coordinate scale uniform
+    glUniform1f(state->coord_scale_location, (GLfloat)state->coord_scale);
+
     // Set buffer
     glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
 
-    glVertexAttribPointer(state->position_location, 2, GL_FLOAT, GL_FALSE, 5*sizeof(GL_FLOAT), 0);
+    // Shorts are normalized to [-1,1]
+    glVertexAttribPointer(state->position_location, 2, GL_SHORT, GL_TRUE, 2*sizeof(GLshort), 0);
     glEnableVertexAttribArray(state->position_location);
-    glVertexAttribPointer(state->color_location, 3, GL_FLOAT, GL_FALSE, 5*sizeof(GL_FLOAT),(void*)(2*sizeof(GL_FLOAT)));
-    glEnableVertexAttribArray(state->color_location);
 
     // Blend is required to show cleared color when the frag shader draws transparent pixels
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // Draw
-    glDrawArrays(GL_POINTS, 0, num_points);
+    // Draw each ranks range of points in its color
+    for(i=0; i<num_ranks; i++) {
+        if(coord_counts[i]) {
+            glUniform3fv(state->color_location, 1, colors_by_rank+3*i);
+            glDrawArrays(GL_POINTS, state->ring.firsts[i], coord_counts[i]/2);
+        }
+    }
 }
@@ -32,6 +32,8 @@ THE SOFTWARE.
     #include "egl_utils.h"
 #endif
 
+#include "ogl_utils.h"
+
 typedef struct particles_t {
     // Program handle
     GLuint program;
@@ -41,19 +43,24 @@ typedef struct particles_t {
     GLint color_location;
     GLint diameter_pixels_location;
     GLint radius_world_location;
+    GLint coord_scale_location;
+
+    // Received coordinates are scaled by this after normalizing
+    float coord_scale;
 
     // Screen dimensions
     int screen_width;
     int screen_height;
 
     // buffers
-    GLuint vbo;
+    vertex_ring_t ring;
+    GLuint vbo; // Buffer of the ring drawn from
 } particles_t;
 
 void init_particles(particles_t *state, int screen_width, int screen_height);
-void render_particles(float *points, float diameter_pixels, int num_points, particles_t *state);
+void render_particles(short **rank_coords, int *coord_counts, float *colors_by_rank, int num_ranks, float diameter_pixels, particles_t *state);
 void create_particle_shaders(particles_t *state);
-void draw_particles(particles_t *state, float diameter_pixels, int num_points);
+void draw_particles(particles_t *state, float diameter_pixels, int *coord_counts, float *colors_by_rank, int num_ranks);
 void create_particle_buffers(particles_t *state);
 
 #endif
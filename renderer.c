@@ -32,10 +32,13 @@ THE SOFTWARE.
 #include "mpi.h"
 #include "geometry.h"
 #include "communication.h"
+#include "frame_stream.h"
 #include "fluid.h"
 #include "font_gl.h"
 #include "dividers_gl.h"
 #include "exit_menu_gl.h"
+#include "rectangle_gl.h"
+#include "scene.h"
 #include "renderer.h"
 
 #ifdef LIGHT
@@ -59,6 +62,7 @@ int start_renderer()
     render_state.pause = false;
     render_state.quit_mode = false;
     render_state.liquid = true;
+    render_state.dual_blur = false;
     set_activity_time(&render_state);
     render_state.screen_width = gl_state.screen_width;
     render_state.screen_height = gl_state.screen_height;
@@ -66,15 +70,21 @@ int start_renderer()
     // Initialize particles OpenGL state
     particles_t particle_GLstate;
     init_particles(&particle_GLstate, gl_state.screen_width, gl_state.screen_height);
+    particle_GLstate.coord_scale = FRAME_COORD_SCALE;
 
     // Initialize liquid OpenGL state
     liquid_t liquid_GLstate;
     init_liquid(&liquid_GLstate, gl_state.screen_width, gl_state.screen_height);
+    liquid_GLstate.coord_scale = FRAME_COORD_SCALE;
 
     // Initialize mover OpenGL state
     mover_t mover_GLstate;
     init_mover(&mover_GLstate);
 
+    // Initialize obstacle OpenGL state
+    rectangle_t obstacle_GLstate;
+    init_rectangle(&obstacle_GLstate);
+
     // Initialize font OpenGL state
     font_t font_state;
     init_font(&font_state, gl_state.screen_width, gl_state.screen_height);
@@ -100,9 +110,14 @@ int start_renderer()
 
     // Number of processes
     int num_procs, num_compute_procs, num_compute_procs_active;
-    MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
-    num_compute_procs = num_procs - 1;
-    num_compute_procs_active = num_compute_procs;
+    MPI_Comm_size(MPI_COMM_SIM, &num_procs);
+    num_compute_procs = num_procs - NUM_RENDER_PROCS;
+    num_compute_procs_active = INITIAL_ACTIVE_PROCS(num_compute_procs);
+
+    // Render rank 0 handles input and the parameters, other render ranks only show their tile
+    int render_rank;
+    MPI_Comm_rank(MPI_COMM_RENDER, &render_rank);
+    bool input_rank = render_rank == 0;
 
     // Allocate array of paramaters
     // So we can use MPI_Gather instead of MPI_Gatherv
@@ -116,26 +131,68 @@ int start_renderer()
     render_state.node_params = node_params;
     render_state.master_params = master_params;
     render_state.num_compute_procs = num_compute_procs;
-    render_state.num_compute_procs_active = num_compute_procs;
+    render_state.num_compute_procs_active = num_compute_procs_active;
     render_state.selected_parameter = 0;
     render_state.return_value = 0;
+    render_state.tile_x = render_rank % RENDER_TILES_X;
+    render_state.tile_y = render_rank / RENDER_TILES_X;
 
-    int i,j;
+    int i;
 
-    // Broadcast pixels ratio
+    // Broadcast pixels ratio of the entire display, all tiles have the same resolution
     short pixel_dims[2];
-    pixel_dims[0] = (short)gl_state.screen_width;
-    pixel_dims[1] = (short)gl_state.screen_height;
-    MPI_Bcast(pixel_dims, 2, MPI_SHORT, 0, MPI_COMM_WORLD);
+    pixel_dims[0] = (short)(gl_state.screen_width * RENDER_TILES_X);
+    pixel_dims[1] = (short)(gl_state.screen_height * RENDER_TILES_Y);
+    MPI_Bcast(pixel_dims, 2, MPI_SHORT, 0, MPI_COMM_SIM);
 
-    // Recv simulation world dimensions from global rank 1
+    // Recv simulation world dimensions from the first compute rank
     float sim_dims[2];
-    MPI_Recv(sim_dims, 2, MPI_FLOAT, 1, 8, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Recv(sim_dims, 2, MPI_FLOAT, NUM_RENDER_PROCS, 8, MPI_COMM_SIM, MPI_STATUS_IGNORE);
     render_state.sim_width = sim_dims[0];
     render_state.sim_height = sim_dims[1];
+    reset_view(&render_state);
     // Receive number of global particles
     int max_particles;
-    MPI_Recv(&max_particles, 1, MPI_INT, 1, 9, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Recv(&max_particles, 1, MPI_INT, NUM_RENDER_PROCS, 9, MPI_COMM_SIM, MPI_STATUS_IGNORE);
+    // Receive static obstacles of the scene
+    int number_obstacles;
+    AABB_t obstacles[MAX_SCENE_BOXES];
+    MPI_Recv(&number_obstacles, 1, MPI_INT, NUM_RENDER_PROCS, 10, MPI_COMM_SIM, MPI_STATUS_IGNORE);
+    MPI_Recv(obstacles, number_obstacles*sizeof(AABB_t), MPI_BYTE, NUM_RENDER_PROCS, 11, MPI_COMM_SIM, MPI_STATUS_IGNORE);
+    float obstacle_color[3] = {0.4f, 0.4f, 0.4f};
+
+    // Particle radius in pixels
+    #ifdef RASPI
+    float particle_diameter_pixels = gl_state.screen_width * 0.0125;
+    float liquid_particle_diameter_pixels = gl_state.screen_width * 0.020;
+    #else
+    float particle_diameter_pixels = gl_state.screen_width * 0.0125;
+    float liquid_particle_diameter_pixels = gl_state.screen_width * 0.020;
+    #endif
+
+    // Liquid density field matches the reduced resolution liquid texture
+    float field_dims[3];
+    field_dims[0] = gl_state.screen_width/liquid_GLstate.reduction;
+    field_dims[1] = gl_state.screen_height/liquid_GLstate.reduction;
+    field_dims[2] = liquid_particle_diameter_pixels/liquid_GLstate.reduction;
+
+    // Window compute ranks put particle coordinates into
+    frame_window_t frame_window;
+    char *frame_memory = NULL;
+    #ifdef ZERO_COPY_FRAMES
+    // The window is a persistently mapped vertex buffer if GL supports one, coordinates are then drawn where they arrive
+    // A frame drawn in place stays unreleased until the next arrives, by which time the GPU is normally done reading it
+    mapped_buffer_t frame_buffer;
+    bool frame_in_flight = false;
+    if(create_mapped_buffer(&frame_buffer, frame_window_bytes(num_compute_procs, max_particles, field_dims))) {
+        frame_memory = frame_buffer.mapped;
+        particle_GLstate.ring.frames = &frame_buffer;
+        liquid_GLstate.ring.frames = &frame_buffer;
+    }
+    else
+        printf("Persistent buffer mapping unsupported, frames will be copied\n");
+    #endif
+    create_frame_window(&frame_window, num_compute_procs, max_particles, field_dims, frame_memory);
 
     // Calculate world unit to pixel
     float world_to_pix_scale = gl_state.screen_width/render_state.sim_width;
@@ -144,27 +201,30 @@ int start_renderer()
     int *param_counts = malloc(num_procs * sizeof(int));
     int *param_displs = malloc(num_procs * sizeof(int));
     for(i=0; i<num_procs; i++) {
-        param_counts[i] = i?1:0; // will not receive from rank 0
-        param_displs[i] = i?i-1:0; // rank i will reside in params[i-1]
+        param_counts[i] = i<NUM_RENDER_PROCS?0:1; // will not receive from render ranks
+        param_displs[i] = i<NUM_RENDER_PROCS?0:i-NUM_RENDER_PROCS; // rank i will reside in params[i-NUM_RENDER_PROCS]
     }
-    // Initial gather
-    MPI_Gatherv(MPI_IN_PLACE, 0, TunableParamtype, node_params, param_counts, param_displs, TunableParamtype, 0, MPI_COMM_WORLD);
+    // Initial gather, other render ranks receive the parameters from the input rank
+    if(input_rank)
+        MPI_Gatherv(MPI_IN_PLACE, 0, TunableParamtype, node_params, param_counts, param_displs, TunableParamtype, 0, MPI_COMM_SIM);
+    else
+        MPI_Gatherv(NULL, 0, TunableParamtype, NULL, NULL, NULL, TunableParamtype, 0, MPI_COMM_SIM);
+    MPI_Bcast(node_params, num_compute_procs, TunableParamtype, 0, MPI_COMM_RENDER);
 
     // Fill in master parameters
     for(i=0; i<render_state.num_compute_procs; i++)
         render_state.master_params[i] = node_params[i];
 
+    // Parameters are only sent when changed, by the input rank
+    param_channel_t param_channel;
+    if(input_rank)
+        init_param_channel(&param_channel, num_compute_procs, node_params);
+    else
+        init_param_receiver(&param_channel);
+
     // Set mover state
     mover_GLstate.mover_type = render_state.master_params[0].mover_type;
 
-    // Allocate particle receive array
-    int num_coords = 2;
-    short *particle_coords = malloc(num_coords * max_particles*sizeof(short));
-
-    // Allocate points array(position + color)
-    int point_size = 5 * sizeof(float);
-    float *points = malloc(point_size*max_particles);
-
     // Allocate mover point array(position + color)
     float mover_center[2];
     float mover_color[3];
@@ -174,8 +234,14 @@ int start_renderer()
 
     // Number of coordinates received from each proc
     int *particle_coordinate_counts = malloc(num_compute_procs * sizeof(int));
-    // Keep track of order in which particles received
-    int *particle_coordinate_ranks = malloc(num_compute_procs * sizeof(int));
+    // Number of particles on each proc, including those outside the view
+    int *particle_counts = malloc(num_compute_procs * sizeof(int));
+    // Partition of each proc as of the last frame, compute ranks balance them
+    float *partition_edges = malloc(2 * num_compute_procs * sizeof(float));
+    for(i=0; i<num_compute_procs; i++) {
+        partition_edges[2*i] = node_params[i].node_start_x;
+        partition_edges[2*i+1] = node_params[i].node_end_x;
+    }
 
     // Create color index, equally spaced around HSV
     float *colors_by_rank = malloc(3*render_state.num_compute_procs*sizeof(float));
@@ -192,7 +258,7 @@ int start_renderer()
         hsv_to_rgb(HSV, colors_by_rank+3*i);
     }
 
-    #define ColorForRank(red,blue,green,rank) if (rank < render_state.num_compute_procs) { colors_by_rank[rank*3] = red / 255.0;
+    #define ColorForRank(red,blue,green,rank) if (rank < render_state.num_compute_procs) { colors_by_rank[rank*3] = red / 255.0; colors_by_rank[rank*3+1] = blue / 255.0; colors_by_rank[rank*3+2] = green / 255.0; }
     // red
     // ColorForRank(255, 0, 0, 0);
     // light blue
@@ -214,38 +280,21 @@ int start_renderer()
     ColorForRank(255, 198, 0, 7);
 
     #if defined LIGHT || defined BLINK1
-    MPI_Bcast(colors_by_rank, 3*render_state.num_compute_procs, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(colors_by_rank, 3*render_state.num_compute_procs, MPI_FLOAT, 0, MPI_COMM_SIM);
     #endif
 
     int num_coords_rank;
-    int current_rank, num_parts;
     float mover_gl_dims[2];
 
     int frames_per_fps = 30;
-    #ifdef RASPI
-    int frames_per_check = 1;
-    #else
-    int frames_per_check = 1;
-    #endif
     int num_steps = 0;
     double current_time;
     double wall_time = MPI_Wtime();
     float fps=0.0f;
 
-    // Setup MPI requests used to gather particle coordinates
-    MPI_Request coord_reqs[num_compute_procs];
-    int src, coords_recvd;
+    // Coordinates of each compute rank
+    short **particle_coords;
     float gl_x, gl_y;
-    // Particle radius in pixels
-    #ifdef RASPI
-    float particle_diameter_pixels = gl_state.screen_width * 0.0125;
-    float liquid_particle_diameter_pixels = gl_state.screen_width * 0.020;
-    #else
-    float particle_diameter_pixels = gl_state.screen_width * 0.0125;
-    float liquid_particle_diameter_pixels = gl_state.screen_width * 0.020;
-    #endif
-
-    MPI_Status status;
 
     // Remove all partitions but one initially
 //    for(i=0; i<render_state.num_compute_procs-1; i++)
@@ -262,53 +311,41 @@ int start_renderer()
         }
 
         // Check to see if simulation should close
-        if(window_should_close(&gl_state)) {
-            for(i=0; i<render_state.num_compute_procs; i++)
-                render_state.node_params[i].kill_sim = true;
-            // Send kill paramaters to compute nodes
-            MPI_Scatterv(node_params, param_counts, param_displs, TunableParamtype, MPI_IN_PLACE, 0, TunableParamtype, 0, MPI_COMM_WORLD);
-            break;
-        }
+        bool close = input_rank && window_should_close(&gl_state);
 
-        // Check for user keyboard/mouse input
-        if(render_state.pause) {
-            while(render_state.pause)
+        if(input_rank && !close) {
+            // Check for user keyboard/mouse input
+            if(render_state.pause) {
+                while(render_state.pause)
+                    check_user_input(&gl_state);
+            }
+            else
                 check_user_input(&gl_state);
+
+            // Check if inactive
+            if(!input_is_active(&render_state))
+                update_inactive_state(&render_state);
+
+            // Update node params with master param values
+            update_node_params(&render_state);
+
+            // Send updated paramaters to compute nodes
+            publish_params(&param_channel, node_params);
         }
-        else
+        else if(!input_rank) // Keep the window responsive, input is overridden by the input rank
             check_user_input(&gl_state);
 
-        // Check if inactive
-        if(!input_is_active(&render_state))
-            update_inactive_state(&render_state);
-
-        // Update node params with master param values
-        update_node_params(&render_state);
-
-        // Send updated paramaters to compute nodes
-        MPI_Scatterv(node_params, param_counts, param_displs, TunableParamtype, MPI_IN_PLACE, 0, TunableParamtype, 0, MPI_COMM_WORLD);
-
-            // Retrieve all particle coordinates (x,y)
-            // Potentially probe is expensive? Could just allocated num_compute_procs*num_particles_global and async recv
-            // OR do synchronous recv...very likely that synchronous receive is as fast as anything else
-            coords_recvd = 0;
-            for(i=0; i<render_state.num_compute_procs; i++) {
-                // Wait until message is ready from any proc
-                MPI_Probe(MPI_ANY_SOURCE, 17, MPI_COMM_WORLD, &status);
-                // Retrieve probed values
-                src = status.MPI_SOURCE;
-                particle_coordinate_ranks[i] = src-1;
-                MPI_Get_count(&status, MPI_SHORT, &particle_coordinate_counts[src-1]); // src-1 to account for render node
-                // Start async recv using probed values
-                MPI_Irecv(particle_coords + coords_recvd, particle_coordinate_counts[src-1], MPI_SHORT, src, 17, MPI_COMM_WORLD, &coord_reqs[src-1]);
-                // Update total number of floats recvd
-                coords_recvd += particle_coordinate_counts[src-1];
+        // Other render ranks follow the input ranks view and parameters
+        close = sync_render_ranks(&render_state, close);
+        if(close) {
+            if(input_rank) {
+                for(i=0; i<render_state.num_compute_procs; i++)
+                    render_state.node_params[i].kill_sim = true;
+                // Send kill paramaters to compute nodes
+                publish_params(&param_channel, node_params);
             }
-
-        // Ensure a balanced partition
-        // We pass in number of coordinates instead of particle counts
-        if(num_steps%frames_per_check == 0)
-            check_partition_left(&render_state, particle_coordinate_counts, coords_recvd);
+            break;
+        }
 
         // Clear background
         glClearColor(0.15, 0.15, 0.15, 1.0);
@@ -326,10 +363,11 @@ int start_renderer()
         mover_color[2] = 0.0f;
         // Mover bounding rectangle half width/height lengths in ogl system
         // Subtract off particle diamter so no particle/mover penetration
-        mover_gl_dims[0] = render_state.master_params[0].mover_width/(render_state.sim_width*0.5f) - particle_diameter_pixels/(gl_state.screen_width*0.5f) ;
-        mover_gl_dims[1] = render_state.master_params[0].mover_height/(render_state.sim_height*0.5f) - particle_diameter_pixels/(gl_state.screen_height*0.5f);
+        mover_gl_dims[0] = render_state.master_params[0].mover_width*render_state.view_zoom*RENDER_TILES_X/(render_state.sim_width*0.5f) - particle_diameter_pixels/(gl_state.screen_width*0.5f) ;
+        mover_gl_dims[1] = render_state.master_params[0].mover_height*render_state.view_zoom*RENDER_TILES_Y/(render_state.sim_height*0.5f) - particle_diameter_pixels/(gl_state.screen_height*0.5f);
 
-        render_all_text(&font_state, &render_state, fps);
+        if(input_rank)
+            render_all_text(&font_state, &render_state, fps);
 
         if(render_state.show_dividers)
         {
@@ -338,56 +376,69 @@ int start_renderer()
             {
                 float start_gl_x, end_gl_x;
                 float null_y;
-                sim_to_opengl(&render_state, node_params[i].node_start_x, 0.0, &start_gl_x, &null_y);
-                sim_to_opengl(&render_state, node_params[i].node_end_x, 0.0, &end_gl_x, &null_y);
+                sim_to_opengl(&render_state, partition_edges[2*i], 0.0, &start_gl_x, &null_y);
+                sim_to_opengl(&render_state, partition_edges[2*i+1], 0.0, &end_gl_x, &null_y);
                 node_edges[2*i] = start_gl_x;
                 node_edges[2*i+1] = end_gl_x;
             }
             render_dividers(&dividers_state, node_edges, colors_by_rank, render_state.num_compute_procs_active);
         }
 
-        // Wait for all coordinates to be received
-        MPI_Waitall(num_compute_procs, coord_reqs, MPI_STATUSES_IGNORE);
+        // Wait for all coordinates to be put into the frame window
+        particle_coords = wait_frame(&frame_window, particle_coordinate_counts, particle_counts, partition_edges);
 
-        // Render liquid or particles
-        if(render_state.liquid) {
-            // Create points array (x,y)
-            for(j=0; j<coords_recvd; j+=2) {
-                points[j] = particle_coords[j]/(float)SHRT_MAX;
-                points[j+1] = particle_coords[j+1]/(float)SHRT_MAX;
-            }
-            render_liquid(points, liquid_particle_diameter_pixels, coords_recvd/2, &liquid_GLstate);
+        #ifdef ZERO_COPY_FRAMES
+        // Frames are released in order, the previous one before this
+        if(frame_in_flight) {
+            wait_mapped_buffer(&frame_buffer, frame_window.released % 2);
+            release_frame(&frame_window);
+            frame_in_flight = false;
         }
-        else {
-            // Create points array (x,y,r,g,b)
-            i = 0;
-            current_rank = particle_coordinate_ranks[i];
-            // j == coordinate pair
-            for(j=0, num_parts=1; j<coords_recvd/2; j++, num_parts++) {
-                 // Check if we are processing a new rank's particles
-                 if ( num_parts > particle_coordinate_counts[current_rank]/2){
-                    current_rank =  particle_coordinate_ranks[++i];
-                    num_parts = 1;
-                    // Find next rank with particles if current_rank has 0 particles
-                    while(!particle_coordinate_counts[current_rank])
-                        current_rank = particle_coordinate_ranks[++i];
-                }
-                points[j*5]   = particle_coords[j*2]/(float)SHRT_MAX;
-                points[j*5+1] = particle_coords[j*2+1]/(float)SHRT_MAX;
-                points[j*5+2] = colors_by_rank[3*current_rank];
-                points[j*5+3] = colors_by_rank[3*current_rank+1];
-                points[j*5+4] = colors_by_rank[3*current_rank+2];
-            }
+        #endif
 
-            render_particles(points, particle_diameter_pixels, coords_recvd/2, &particle_GLstate);
+        // Blur selected at runtime
+        liquid_GLstate.dual_blur = render_state.dual_blur;
+
+        // Render liquid from density tiles, liquid, or particles
+        if(!particle_coords) {
+            release_frame(&frame_window);
+            render_liquid_field(frame_window.field, &liquid_GLstate);
+        }
+        // Received shorts are uploaded as they are, the frame is released once they're copied
+        // or, if drawn in place, once the GPU is done with them
+        else {
+            if(render_state.liquid)
+                render_liquid(particle_coords, particle_coordinate_counts, render_state.num_compute_procs, liquid_particle_diameter_pixels, &liquid_GLstate);
+            else
+                render_particles(particle_coords, particle_coordinate_counts, colors_by_rank, render_state.num_compute_procs, particle_diameter_pixels, &particle_GLstate);
+
+            #ifdef ZERO_COPY_FRAMES
+            if(frame_memory)
+                frame_in_flight = true;
+            else
+            #endif
+            release_frame(&frame_window);
+        }
+        // Render obstacles over particles to hide penetration
+        for(i=0; i<number_obstacles; i++) {
+            float obstacle_center[2], obstacle_gl_dims[2];
+            sim_to_opengl(&render_state, obstacles[i].min_x, obstacles[i].min_y, &gl_x, &gl_y);
+            sim_to_opengl(&render_state, obstacles[i].max_x, obstacles[i].max_y, &obstacle_gl_dims[0], &obstacle_gl_dims[1]);
+            obstacle_gl_dims[0] -= gl_x;
+            obstacle_gl_dims[1] -= gl_y;
+            obstacle_center[0] = gl_x + obstacle_gl_dims[0]*0.5f;
+            obstacle_center[1] = gl_y + obstacle_gl_dims[1]*0.5f;
+            render_rectangle(&obstacle_GLstate, obstacle_center, obstacle_gl_dims, obstacle_color);
         }
+
         // Render exit menu
-        if(render_state.quit_mode)
+        if(input_rank && render_state.quit_mode)
             render_exit_menu(&exit_menu_state, mover_center[0], mover_center[1]);
         else // Render over particles to hide penetration
             render_mover(mover_center, mover_gl_dims, mover_color, &mover_GLstate);
 
-        // Swap front/back buffers
+        // Swap front/back buffers together on all tiles
+        MPI_Barrier(MPI_COMM_RENDER);
         swap_ogl(&gl_state);
 
         num_steps++;
@@ -397,6 +448,9 @@ int start_renderer()
     shutdown_rgb_light(&light_state);
     #endif
 
+    close_param_channel(&param_channel);
+    free_frame_window(&frame_window);
+
     // Clean up memory
     exit_ogl(&gl_state);
     exit_exit_menu(&exit_menu_state);
@@ -404,96 +458,89 @@ int start_renderer()
     free(master_params);
     free(param_counts);
     free(param_displs);
-    free(particle_coords);
-    free(points);
     free(particle_coordinate_counts);
-    free(particle_coordinate_ranks);
+    free(particle_counts);
+    free(partition_edges);
     free(colors_by_rank);
 
     return render_state.return_value;
 }
 
 // Translate between OpenGL coordinates with origin at screen center
-// to simulation coordinates
+// to simulation coordinates within the current view
+// Input covers the entire view, spanning all tiles
 void opengl_to_sim(render_t *render_state, float x, float y, float *sim_x, float *sim_y)
 {
-    float half_width = render_state->sim_width*0.5f;
-    float half_height = render_state->sim_height*0.5f;
+    float half_width = render_state->sim_width*0.5f/render_state->view_zoom;
+    float half_height = render_state->sim_height*0.5f/render_state->view_zoom;
 
-    *sim_x = x*half_width + half_width;
-    *sim_y = y*half_height + half_height;
+    *sim_x = x*half_width + render_state->view_center_x;
+    *sim_y = y*half_height + render_state->view_center_y;
 }
 
 // Translate between simulation coordinates, origin bottom left, and opengl -1,1 center of screen coordinates
+// within this render ranks tile of the current view
 void sim_to_opengl(render_t *render_state, float x, float y, float *gl_x, float *gl_y)
 {
-    float half_width = render_state->sim_width*0.5f;
-    float half_height = render_state->sim_height*0.5f;
+    float half_width = render_state->sim_width*0.5f/(render_state->view_zoom*RENDER_TILES_X);
+    float half_height = render_state->sim_height*0.5f/(render_state->view_zoom*RENDER_TILES_Y);
+    float center_x = render_state->view_center_x + (2*render_state->tile_x + 1 - RENDER_TILES_X)*half_width;
+    float center_y = render_state->view_center_y + (2*render_state->tile_y + 1 - RENDER_TILES_Y)*half_height;
+
+    *gl_x = (x - center_x)/half_width;
+    *gl_y = (y - center_y)/half_height;
+}
 
-    *gl_x = x/half_width - 1.0f;
-    *gl_y = y/half_height - 1.0f;
+// Share the input ranks render state with the other render ranks, collective over MPI_COMM_RENDER
+// Returns true if the input rank is closing
+bool sync_render_ranks(render_t *render_state, bool close)
+{
+    render_sync_t sync;
+    sync.view_center_x = render_state->view_center_x;
+    sync.view_center_y = render_state->view_center_y;
+    sync.view_zoom = render_state->view_zoom;
+    sync.num_compute_procs_active = render_state->num_compute_procs_active;
+    sync.liquid = render_state->liquid;
+    sync.dual_blur = render_state->dual_blur;
+    sync.show_dividers = render_state->show_dividers;
+    sync.close = close;
+
+    // Render ranks run the same binary so the struct is sent as bytes
+    MPI_Bcast(&sync, sizeof(render_sync_t), MPI_BYTE, 0, MPI_COMM_RENDER);
+    MPI_Bcast(render_state->node_params, render_state->num_compute_procs, TunableParamtype, 0, MPI_COMM_RENDER);
+
+    int render_rank;
+    MPI_Comm_rank(MPI_COMM_RENDER, &render_rank);
+    if(render_rank == 0)
+        return sync.close;
+
+    render_state->view_center_x = sync.view_center_x;
+    render_state->view_center_y = sync.view_center_y;
+    render_state->view_zoom = sync.view_zoom;
+    render_state->num_compute_procs_active = sync.num_compute_procs_active;
+    render_state->liquid = sync.liquid;
+    render_state->dual_blur = sync.dual_blur;
+    render_state->show_dividers = sync.show_dividers;
+
+    // The mover and dividers are drawn from the master parameters
+    memcpy(render_state->master_params, render_state->node_params, render_state->num_compute_procs*sizeof(tunable_parameters));
+
+    return sync.close;
 }
 
 void update_node_params(render_t *render_state)
 {
     int i;
         // Update all node parameters with master paramter values
-    for(i=0; i<render_state->num_compute_procs; i++)
+    for(i=0; i<render_state->num_compute_procs; i++) {
         render_state->node_params[i] = render_state->master_params[i];
-}
-
-// Checks for a balanced number of particles on each compute node
-// If unbalanced the partition between nodes will change
-// Check from right to left
-void check_partition_left(render_t *render_state, int *particle_counts, int total_particles)
-{
-    int rank, diff;
-    float h, dx, length, length_left, length_right;
-
-    // Particles per proc if evenly divided
-    int even_particles = total_particles/render_state->num_compute_procs_active;
-    int max_diff = even_particles/15.0f;
-
-    // Fixed distance to move partition is 0.125*smoothing radius
-    h = render_state->master_params[0].smoothing_radius;
-    dx = h*0.125;
-
-    tunable_parameters *master_params = render_state->master_params;
-
-    for(rank=render_state->num_compute_procs_active; rank-- > 1; )
-    {
-        length =  master_params[rank].node_end_x - master_params[rank].node_start_x;
-        length_left =  master_params[rank-1].node_end_x - master_params[rank-1].node_start_x;
-        diff = particle_counts[rank] - even_particles;
-
-        // current rank has too many particles
-        if( diff > max_diff && length > 2*h) {
-            master_params[rank].node_start_x += dx;
-            master_params[rank-1].node_end_x = master_params[rank].node_start_x;
-        }
-        // current rank has too few particles
-        else if (diff < -max_diff && length_left > 2*h) {
-            master_params[rank].node_start_x -= dx;
-            master_params[rank-1].node_end_x = master_params[rank].node_start_x;
-        }
-    }
-
-    // Left most partition has a tendency to not balance correctly so we test it explicitly
-    if(render_state->num_compute_procs_active > 1)
-    {
-        length =  master_params[0].node_end_x - master_params[0].node_start_x;
-        length_right =  master_params[1].node_end_x - master_params[1].node_start_x;
-        diff = particle_counts[0] - even_particles;
-
-        // current rank has too many particles
-        if( diff > max_diff && length > 2*h) {
-            master_params[0].node_end_x -= dx;
-            master_params[1].node_start_x = master_params[0].node_end_x;
-        }
-        else if (diff < -max_diff && length_right > 2*h) {
-            master_params[0].node_end_x += dx;
-            master_params[1].node_start_x = master_params[0].node_end_x;
-        }
+        #ifdef DENSITY_FRAMES
+        // Liquid is rendered from density tiles splatted by the compute ranks
+        render_state->node_params[i].density_field = render_state->liquid;
+        #endif
+        // Compute ranks only send particles within the view
+        opengl_to_sim(render_state, -1.0f, -1.0f, &render_state->node_params[i].view_min_x, &render_state->node_params[i].view_min_y);
+        opengl_to_sim(render_state, 1.0f, 1.0f, &render_state->node_params[i].view_max_x, &render_state->node_params[i].view_max_y);
     }
 }
 
@@ -513,8 +560,10 @@ bool input_is_active(render_t *render_state)
 // Renderer will move mover if annactive
 void update_inactive_state(render_t *render_state)
 {
+    // Mover position over the entire view, as set by input
     float gl_x, gl_y;
-    sim_to_opengl(render_state, render_state->master_params[0].mover_center_x, render_state->master_params[0].mover_center_y, &gl_x, &gl_y);
+    gl_x = (render_state->master_params[0].mover_center_x - render_state->view_center_x)*2.0f*render_state->view_zoom/render_state->sim_width;
+    gl_y = (render_state->master_params[0].mover_center_y - render_state->view_center_y)*2.0f*render_state->view_zoom/render_state->sim_height;
 
     // Reset to water params
     set_fluid_x(render_state);
@@ -526,6 +575,9 @@ void update_inactive_state(render_t *render_state)
     // Reset mover radius
     reset_mover_size(render_state);
 
+    // Show the entire world
+    reset_view(render_state);
+
     // Add in all nodes
     int i;
     for(i=render_state->num_compute_procs_active; i<=render_state->num_compute_procs; i++)
@@ -58,15 +58,33 @@ typedef struct render_t {
     struct exit_menu_t *exit_menu_state;
     int return_value;
     bool liquid;
+    bool dual_blur;      // Liquid is blurred with the dual filter instead of the Gaussian
+    float view_center_x; // Simulation coordinates shown at the center of the screen
+    float view_center_y;
+    float view_zoom;     // The view spans sim_width/view_zoom by sim_height/view_zoom
+    int tile_x;          // Tile of the view shown by this render rank, tile 0,0 handles input
+    int tile_y;
 } render_t;
 
+// Render state shared each frame by the render rank handling input with the other render ranks
+typedef struct RENDER_SYNC_T {
+    float view_center_x;
+    float view_center_y;
+    float view_zoom;
+    int num_compute_procs_active;
+    char liquid;
+    char dual_blur;
+    char show_dividers;
+    char close;
+} render_sync_t;
+
 int start_renderer();
 void opengl_to_sim(render_t *render_state, float x, float y, float *sim_x, float *sim_y);
 void sim_to_opengl(render_t *render_state, float x, float y, float *gl_x, float *gl_y);
 void update_node_params(render_t *render_state);
+bool sync_render_ranks(render_t *render_state, bool close);
 void checkPartitions(render_t *render_state, int *particle_counts, int total_particles);
 void hsv_to_rgb(float* hsv, float *rgb);
-void check_partition_left(render_t *render_state, int *particle_counts, int total_particles);
 void set_activity_time(render_t *render_state);
 bool input_is_active(render_t *render_state);
 void update_inactive_state(render_t *render_state);
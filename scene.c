@@ -0,0 +1,198 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include "mpi.h"
+#include "scene.h"
+#include "fluid.h"
+
+// Tunable parameters a scene may set by name
+typedef struct scene_param_t {
+    const char *name;
+    size_t offset;
+} scene_param_t;
+
+static const scene_param_t scene_params[] = {
+    {"g", offsetof(tunable_parameters, g)},
+    {"k", offsetof(tunable_parameters, k)},
+    {"k_near", offsetof(tunable_parameters, k_near)},
+    {"k_spring", offsetof(tunable_parameters, k_spring)},
+    {"sigma", offsetof(tunable_parameters, sigma)},
+    {"beta", offsetof(tunable_parameters, beta)},
+    {"rest_density", offsetof(tunable_parameters, rest_density)},
+    {"time_step", offsetof(tunable_parameters, time_step)},
+    {"halo_refresh_fraction", offsetof(tunable_parameters, halo_refresh_fraction)},
+    {"mover_width", offsetof(tunable_parameters, mover_width)},
+    {"mover_height", offsetof(tunable_parameters, mover_height)}
+};
+
+static void set_scene_param(const char *name, float value, tunable_parameters *tunable_params)
+{
+    size_t i;
+    for(i=0; i<sizeof(scene_params)/sizeof(scene_param_t); i++) {
+        if(!strcmp(name, scene_params[i].name)) {
+            *(float*)((char*)tunable_params + scene_params[i].offset) = value;
+            return;
+        }
+    }
+    printf("%s: unknown parameter %s\n", SCENE_FILE, name);
+}
+
+static bool read_box(const char *line, AABB_t *boxes, int *number_boxes)
+{
+    AABB_t box;
+    if(*number_boxes == MAX_SCENE_BOXES)
+        return false;
+    if(sscanf(line, "%*s %f %f %f %f", &box.min_x, &box.min_y, &box.max_x, &box.max_y) != 4)
+        return false;
+    box.min_z = 0.0f;
+    box.max_z = 0.0f;
+    boxes[(*number_boxes)++] = box;
+    return true;
+}
+
+static void parse_scene(FILE *file, scene_t *scene, param *params)
+{
+    char line[256];
+    char keyword[32];
+    char name[32];
+    float value;
+    int line_number = 0;
+    bool ok;
+
+    while(fgets(line, sizeof(line), file)) {
+        line_number++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        if(sscanf(line, "%31s", keyword) != 1)
+            continue;
+
+        if(!strcmp(keyword, "domain")) {
+            scene->height = 0.0f;
+            ok = sscanf(line, "%*s %f %f", &scene->width, &scene->height) >= 1;
+        }
+        else if(!strcmp(keyword, "particles"))
+            ok = sscanf(line, "%*s %d", &scene->number_particles) == 1;
+        else if(!strcmp(keyword, "spacing"))
+            ok = sscanf(line, "%*s %f", &scene->spacing) == 1;
+        else if(!strcmp(keyword, "capacity"))
+            ok = sscanf(line, "%*s %f", &scene->capacity) == 1;
+        else if(!strcmp(keyword, "fluid"))
+            ok = read_box(line, scene->fluid_volumes, &scene->number_fluid_volumes);
+        else if(!strcmp(keyword, "obstacle"))
+            ok = read_box(line, scene->obstacles, &scene->number_obstacles);
+        else if(!strcmp(keyword, "param")) {
+            ok = sscanf(line, "%*s %31s %f", name, &value) == 2;
+            if(ok)
+                set_scene_param(name, value, &params->tunable_params);
+        }
+        else
+            ok = false;
+
+        if(!ok)
+            printf("%s:%d: ignoring %s\n", SCENE_FILE, line_number, line);
+    }
+}
+
+// Set the scene and initial tunable parameters, collective over MPI_COMM_COMPUTE
+// The lead reads SCENE_FILE if there is one, compute ranks run the same binary so both are sent as bytes
+void read_scene(scene_t *scene, param *params)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_COMPUTE, &rank);
+
+    // Built in dam break, the whole world filled with fluid
+    scene->width = 15.0f;
+    scene->height = 0.0f;
+    #ifdef RASPI
+    scene->number_particles = 1500;
+    #else
+    scene->number_particles = 1500;
+    #endif
+    scene->spacing = 0.0f;
+    scene->capacity = 2.0f;
+    scene->number_fluid_volumes = 0;
+    scene->number_obstacles = 0;
+
+    if(rank == 0) {
+        FILE *file = fopen(SCENE_FILE, "r");
+        if(file) {
+            printf("Reading scene %s\n", SCENE_FILE);
+            parse_scene(file, scene, params);
+            fclose(file);
+        }
+    }
+
+    MPI_Bcast(scene, sizeof(scene_t), MPI_BYTE, 0, MPI_COMM_COMPUTE);
+    MPI_Bcast(&params->tunable_params, sizeof(tunable_parameters), MPI_BYTE, 0, MPI_COMM_COMPUTE);
+}
+
+// Clip the fluid volumes to the world and set the particle spacing
+void finalize_scene(scene_t *scene, AABB_t *boundary_global)
+{
+    int i;
+    AABB_t *volume;
+
+    if(scene->number_fluid_volumes == 0) {
+        scene->fluid_volumes[0] = *boundary_global;
+        scene->number_fluid_volumes = 1;
+    }
+
+    // The spacing assumes fluid volumes don't overlap, the particles actually created are counted afterwards
+    float area = 0.0f;
+    for(i=0; i<scene->number_fluid_volumes; i++) {
+        volume = &scene->fluid_volumes[i];
+        volume->min_x = max(volume->min_x, boundary_global->min_x);
+        volume->max_x = min(volume->max_x, boundary_global->max_x);
+        volume->min_y = max(volume->min_y, boundary_global->min_y);
+        volume->max_y = min(volume->max_y, boundary_global->max_y);
+        if(volume->max_x > volume->min_x && volume->max_y > volume->min_y)
+            area += (volume->max_x - volume->min_x) * (volume->max_y - volume->min_y);
+    }
+
+    if(scene->spacing <= 0.0f)
+        scene->spacing = pow(area/scene->number_particles, 1.0/2.0);
+}
+
+// True if a particle placed at (x,y) is inside a fluid volume and outside every obstacle
+// Particles sit at the bottom of a spacing tall row, so a volume holds only whole rows
+bool scene_fluid(scene_t *scene, float x, float y)
+{
+    int i;
+    AABB_t *box;
+    bool fluid = false;
+
+    for(i=0; i<scene->number_fluid_volumes && !fluid; i++) {
+        box = &scene->fluid_volumes[i];
+        fluid = x >= box->min_x && x <= box->max_x && y >= box->min_y && y + scene->spacing <= box->max_y;
+    }
+
+    for(i=0; i<scene->number_obstacles && fluid; i++) {
+        box = &scene->obstacles[i];
+        fluid = !(x > box->min_x && x < box->max_x && y > box->min_y && y < box->max_y);
+    }
+
+    return fluid;
+}
@@ -0,0 +1,61 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014 Adam Simpson
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef fluid_scene_h
+#define fluid_scene_h
+
+#include "fluid.h"
+#include "geometry.h"
+
+// Read by the lead compute rank from the working directory at startup, the built in dam break is used without it
+#define SCENE_FILE "sph.scene"
+
+// Most fluid volumes and obstacles a scene may hold
+#define MAX_SCENE_BOXES 32
+
+// Scene file lines, '#' starts a comment:
+//   domain width [height]            world size, the height follows the display aspect ratio if left out
+//   particles n                      about how many fluid particles to create, sets the spacing
+//   spacing s                        spacing between initial particles, overrides particles
+//   capacity c                       particles a rank has room for as a fraction of all particles
+//   fluid min_x min_y max_x max_y    fluid volume, any number of them, the whole domain if none are given
+//   obstacle min_x min_y max_x max_y static box particles are kept out of
+//   param name value                 initial value of a tunable parameter, e.g. param g 6.0
+struct SCENE_T {
+    float width;
+    float height;         // <= 0.0 to follow the display aspect ratio
+    int number_particles;
+    float spacing;        // <= 0.0 to derive it from number_particles and the fluid area
+    float capacity;
+    int number_fluid_volumes;
+    int number_obstacles;
+    AABB_t fluid_volumes[MAX_SCENE_BOXES];
+    AABB_t obstacles[MAX_SCENE_BOXES];
+};
+
+void read_scene(scene_t *scene, param *params);
+void finalize_scene(scene_t *scene, AABB_t *boundary_global);
+bool scene_fluid(scene_t *scene, float x, float y);
+
+#endif
@@ -0,0 +1,21 @@
+#version 150 core
+in vec2 frag_tex_coord;
+
+uniform sampler2D tex;
+uniform vec2 spread;
+
+out vec4 color;
+
+// Dual filter downsample, the center and four diagonal taps
+// Output texels are centered on source texel corners, as are diagonal taps a whole number of texels away,
+// so bilinear filtering averages four texels at each tap
+void main()
+{
+    float alpha = texture(tex, frag_tex_coord).a * 4.0;
+    alpha += texture(tex, frag_tex_coord + vec2(-spread.x, -spread.y)).a;
+    alpha += texture(tex, frag_tex_coord + vec2( spread.x, -spread.y)).a;
+    alpha += texture(tex, frag_tex_coord + vec2(-spread.x,  spread.y)).a;
+    alpha += texture(tex, frag_tex_coord + vec2( spread.x,  spread.y)).a;
+
+    color = vec4(0.0, 0.0, 0.0, alpha/8.0);
+}
@@ -0,0 +1,22 @@
+varying vec2 frag_tex_coord;
+
+uniform sampler2D tex;
+uniform vec2 spread;
+
+// Dual filter upsample straight to the screen, four diagonal taps
+// The blurred alpha is shaded as the liquid surface in the same pass
+void main() {
+    float alpha = texture2D(tex, frag_tex_coord + vec2(-spread.x, -spread.y)).a;
+    alpha += texture2D(tex, frag_tex_coord + vec2( spread.x, -spread.y)).a;
+    alpha += texture2D(tex, frag_tex_coord + vec2(-spread.x,  spread.y)).a;
+    alpha += texture2D(tex, frag_tex_coord + vec2( spread.x,  spread.y)).a;
+    alpha *= 0.25;
+
+    if(alpha < 0.1)
+        discard;
+
+    float edge = smoothstep(0.1, 0.11, alpha);
+    float white = smoothstep(-0.15,-0.1, -alpha);
+
+    gl_FragColor = vec4(white, white, 1.0, 0.75*edge);
+}
@@ -1,8 +1,9 @@
 attribute vec2 position;
 uniform float diameter_pixels;
+uniform float coord_scale;
 
 void main() {
-   gl_Position = vec4(position, 0.0, 1.0);
+   gl_Position = vec4(position*coord_scale, 0.0, 1.0);
    gl_PointSize = diameter_pixels;
 }
 
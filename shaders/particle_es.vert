@@ -1,16 +1,17 @@
 attribute vec2 position;
-attribute vec3 color;
 
+uniform vec3 color;
 uniform float diameter_pixels;
+uniform float coord_scale;
 
 varying vec3 sphere_color;
 varying vec2 circle_center;
 
 void main() {
-   gl_Position = vec4(position, 0.0, 1.0);
+   gl_Position = vec4(position*coord_scale, 0.0, 1.0);
    gl_PointSize = diameter_pixels;
 
    sphere_color = color;
-   circle_center = position;
+   circle_center = position*coord_scale;
 }
 